@@ -0,0 +1,95 @@
+/*!
+ *  \file bounded_queue.h
+ *  \brief Thread-safe FIFO queue with a maximal size, used between the stages of the
+ *         computer vision pipeline
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ */
+
+#ifndef ucl_drone_BOUNDED_QUEUE_H
+#define ucl_drone_BOUNDED_QUEUE_H
+
+#include <deque>
+
+#include <boost/thread/condition_variable.hpp>
+#include <boost/thread/mutex.hpp>
+
+/*!
+ *  \class BoundedQueue
+ *  \brief FIFO queue shared by one producer thread and one consumer thread.
+ *  push blocks while the queue is full, pop blocks while it is empty.
+ *  Once closed, push fails and pop returns the remaining items then fails.
+ */
+template < class T >
+class BoundedQueue
+{
+private:
+  std::deque< T > items;              //!< queued items
+  size_t capacity;                    //!< maximal number of queued items
+  bool closed;                        //!< true when no item can be pushed anymore
+  boost::mutex mutex;                 //!< protects all the attributes
+  boost::condition_variable not_full;  //!< signaled when an item is popped
+  boost::condition_variable not_empty; //!< signaled when an item is pushed
+
+public:
+  //! Constructor.
+  BoundedQueue(size_t capacity = 1) : capacity(capacity), closed(false)
+  {
+  }
+
+  //! Push item, waiting for some room in the queue. \return false if the queue is closed
+  bool push(const T &item)
+  {
+    boost::unique_lock< boost::mutex > lock(mutex);
+    while (items.size() >= capacity && !closed)
+      not_full.wait(lock);
+    if (closed)
+      return false;
+    items.push_back(item);
+    not_empty.notify_one();
+    return true;
+  }
+
+  //! Push item if there is some room in the queue. \return false if the item was not queued
+  bool tryPush(const T &item)
+  {
+    boost::unique_lock< boost::mutex > lock(mutex);
+    if (items.size() >= capacity || closed)
+      return false;
+    items.push_back(item);
+    not_empty.notify_one();
+    return true;
+  }
+
+  //! Pop the oldest item, waiting for one. \return false if the queue is closed and empty
+  bool pop(T &item)
+  {
+    boost::unique_lock< boost::mutex > lock(mutex);
+    while (items.empty() && !closed)
+      not_empty.wait(lock);
+    if (items.empty())
+      return false;
+    item = items.front();
+    items.pop_front();
+    not_full.notify_one();
+    return true;
+  }
+
+  //! Wake up all waiting threads, further push fail
+  void close()
+  {
+    boost::unique_lock< boost::mutex > lock(mutex);
+    closed = true;
+    not_full.notify_all();
+    not_empty.notify_all();
+  }
+
+  //! \return the number of queued items
+  size_t size()
+  {
+    boost::unique_lock< boost::mutex > lock(mutex);
+    return items.size();
+  }
+};
+
+#endif /* ucl_drone_BOUNDED_QUEUE_H */
@@ -0,0 +1,59 @@
+/*!
+ *  \file brute_force_matcher.h
+ *  \brief Exact descriptor matching with the SIMD kernels of descriptor_distance.h
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  For a few thousand descriptors, comparing all pairs with SIMD kernels is faster than
+ *  building a FLANN index for a single search, and the result is exact.
+ *  Distances follow cv::DescriptorMatcher: L2 (not squared) for float and quantized uint8
+ *  descriptors, number of different bits for binary descriptors.
+ */
+
+#ifndef ucl_drone_BRUTE_FORCE_MATCHER_H
+#define ucl_drone_BRUTE_FORCE_MATCHER_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/flann/flann.hpp>
+
+#include <ucl_drone/computer_vision/descriptor_distance.h>
+
+/**
+ * Find the k nearest train descriptors of each query descriptor, by brute force.
+ * @param[in]  query       Query descriptors (one per row, CV_32F or CV_8U)
+ * @param[in]  train       Train descriptors (same size and type as query)
+ * @param[out] matches     For each query row, its (at most) k nearest train rows sorted by distance
+ * @param[in]  k           Number of neighbours
+ * @param[in]  norm        cv::NORM_L2 or cv::NORM_HAMMING (CV_8U descriptors only)
+ * @param[in]  query_valid Query rows to search (query_valid[i] == 0: no neighbour for row i), all if NULL
+ * @param[in]  train_valid Train rows that can be neighbours (train_valid[j] == 0: row j is skipped), all if NULL
+ */
+void bruteForceKnnMatch(const cv::Mat& query, const cv::Mat& train,
+                        std::vector< std::vector< cv::DMatch > >& matches, int k, int norm,
+                        const std::vector< char >* query_valid = NULL,
+                        const std::vector< char >* train_valid = NULL);
+
+/**
+ * Find the nearest train descriptor of each query descriptor, by brute force.
+ * @param[in]  query   Query descriptors (one per row, CV_32F or CV_8U)
+ * @param[in]  train   Train descriptors (same size and type as query)
+ * @param[out] matches Nearest train row of each query row (no match if train is empty)
+ * @param[in]  norm    cv::NORM_L2 or cv::NORM_HAMMING (CV_8U descriptors only)
+ */
+void bruteForceMatch(const cv::Mat& query, const cv::Mat& train, std::vector< cv::DMatch >& matches,
+                     int norm);
+
+/**
+ * Find the k nearest indexed descriptors of each query descriptor with a FLANN index,
+ * with the same output as bruteForceKnnMatch.
+ * @param[in]  index   FLANN index of the train descriptors (L2 on float rows, or Hamming)
+ * @param[in]  query   Query descriptors (quantized ones are converted to float)
+ * @param[out] matches For each query row, its (at most) k nearest train rows sorted by distance
+ * @param[in]  k       Number of neighbours
+ * @param[in]  norm    cv::NORM_L2 or cv::NORM_HAMMING
+ */
+void flannKnnMatch(cv::flann::Index& index, const cv::Mat& query,
+                   std::vector< std::vector< cv::DMatch > >& matches, int k, int norm);
+
+#endif /* ucl_drone_BRUTE_FORCE_MATCHER_H */
@@ -0,0 +1,88 @@
+/*!
+ *  \file descriptor_distance.h
+ *  \brief Distance kernels between descriptors (L2 for float and quantized uint8 descriptors,
+ *         Hamming for binary ones)
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  Each kernel has a generic version and SIMD versions (SSE2 and AVX2 on x86, NEON on ARM).
+ *  The fastest version supported by the CPU is chosen the first time a kernel is used.
+ *  AVX2 kernels are compiled in descriptor_distance_avx2.cpp, the only file built with -mavx2,
+ *  and are only called if the CPU supports them.
+ */
+
+#ifndef ucl_drone_DESCRIPTOR_DISTANCE_H
+#define ucl_drone_DESCRIPTOR_DISTANCE_H
+
+#include <stdint.h>
+
+/** \class DescriptorDistance
+ *  This class gives access to the distance kernels selected for the CPU
+ */
+class DescriptorDistance
+{
+public:
+  typedef float (*L2SqrFunc)(const float* a, const float* b, int n);
+  typedef int (*L2SqrU8Func)(const uint8_t* a, const uint8_t* b, int n);
+  typedef int (*HammingFunc)(const uint8_t* a, const uint8_t* b, int n);
+
+  //! \return the squared L2 distance between the n-element descriptors a and b
+  static float l2sqr(const float* a, const float* b, int n)
+  {
+    return kernels().l2sqr(a, b, n);
+  }
+
+  //! \return the squared L2 distance between the n-element quantized descriptors a and b
+  static int l2sqr(const uint8_t* a, const uint8_t* b, int n)
+  {
+    return kernels().l2sqr_u8(a, b, n);
+  }
+
+  //! \return the number of different bits between the n-byte descriptors a and b
+  static int hamming(const uint8_t* a, const uint8_t* b, int n)
+  {
+    return kernels().hamming(a, b, n);
+  }
+
+  //! \return the name of the instruction set used by the kernels ("AVX2", "SSE2", "NEON" or "generic")
+  static const char* implementation()
+  {
+    return kernels().name;
+  }
+
+private:
+  /** \struct Kernels
+   *  Kernels chosen for the CPU
+   */
+  struct Kernels
+  {
+    L2SqrFunc l2sqr;
+    L2SqrU8Func l2sqr_u8;
+    HammingFunc hamming;
+    const char* name;
+  };
+
+  static Kernels chooseKernels();
+  static const Kernels& kernels();
+};
+
+// Kernels of each instruction set (to be called through DescriptorDistance)
+float l2sqrGeneric(const float* a, const float* b, int n);
+int l2sqrU8Generic(const uint8_t* a, const uint8_t* b, int n);
+int hammingGeneric(const uint8_t* a, const uint8_t* b, int n);
+#if defined(__SSE2__)
+float l2sqrSSE2(const float* a, const float* b, int n);
+int l2sqrU8SSE2(const uint8_t* a, const uint8_t* b, int n);
+#endif
+#if defined(UCL_DRONE_AVX2_KERNELS)
+float l2sqrAVX2(const float* a, const float* b, int n);
+int l2sqrU8AVX2(const uint8_t* a, const uint8_t* b, int n);
+int hammingAVX2(const uint8_t* a, const uint8_t* b, int n);
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+float l2sqrNEON(const float* a, const float* b, int n);
+int l2sqrU8NEON(const uint8_t* a, const uint8_t* b, int n);
+int hammingNEON(const uint8_t* a, const uint8_t* b, int n);
+#endif
+
+#endif /* ucl_drone_DESCRIPTOR_DISTANCE_H */
@@ -0,0 +1,126 @@
+/*!
+ *  \file feature_types.h
+ *  \brief Registry of keypoint detectors and descriptor extractors, selected at runtime
+ *  \author Arnaud Jacques, Alexandre Leclere & Boris Dehem
+ *  \date 2016-2017
+ *
+ *  The detector and the extractor are chosen with the global parameters
+ *  `feature_detector` and `descriptor_extractor` (see launch/components/global_params.xml).
+ *  Available detectors:  SIFT, SURF, FAST, STAR, BRISK, ORB
+ *  Available extractors: SIFT, SURF, SURF_128, BRISK, ORB, FREAK
+ *  SIFT descriptors are quantized to uint8 (see `quantize_descriptors`): they are 4 times smaller
+ *  in messages and in the map, and still compared with the L2 distance.
+ *  Descriptors are matched by brute force with SIMD kernels (see brute_force_matcher.h), or with
+ *  FLANN if the global parameter `brute_force_matching` is false.
+ *  When the detector and the extractor are the same algorithm (SIFT, SURF, SURF_128 with the SURF
+ *  detector, ORB, BRISK), keypoints are detected and described in a single pass which shares the
+ *  integral image or the scale space (see detectAndCompute), unless `fused_detection` is false.
+ */
+
+#ifndef ucl_drone_FEATURE_TYPES_H
+#define ucl_drone_FEATURE_TYPES_H
+
+#include <ros/ros.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/flann/flann.hpp>
+#include <opencv2/nonfree/features2d.hpp>
+#include <opencv2/nonfree/nonfree.hpp>
+
+#include <ucl_drone/computer_vision/brute_force_matcher.h>
+
+/** \struct DescriptorInfo
+ *  Properties of the descriptors produced by an extractor
+ */
+struct DescriptorInfo
+{
+  std::string name;      //!< Name of the extractor in the registry
+  int size;              //!< Number of elements in one descriptor
+  int type;              //!< OpenCV element type of the descriptors (CV_32F or CV_8U)
+  int norm;              //!< Distance metric used to compare descriptors (cv::NORM_L2 or cv::NORM_HAMMING)
+  double dist_threshold; //!< Max distance s.t. two features descriptions are similar
+  double quantization;   //!< Scale applied to float descriptors stored as uint8 (0 if not quantized)
+};
+
+/** \class FeatureTypes
+ *  This class gives access to the detector and extractor selected in the launch file
+ */
+class FeatureTypes
+{
+private:
+  static std::string _detector_name;
+  static cv::Ptr< cv::FeatureDetector > _detector;
+  static cv::Ptr< cv::DescriptorExtractor > _extractor;
+  static cv::Ptr< cv::Feature2D > _features; //!< fused detector and extractor (NULL if they differ)
+  static DescriptorInfo _descriptor;
+  static bool _brute_force;
+  static bool _quantize;
+  static bool _fused;
+
+public:
+  //! Read `feature_detector` and `descriptor_extractor` in the launch file and build them
+  static bool init();
+
+  //! Build the detector and the extractor registered under the given names
+  static bool init(const std::string &detector_name, const std::string &extractor_name);
+
+  //! Create the detector registered under name (NULL pointer if it does not exist)
+  static cv::Ptr< cv::FeatureDetector > createDetector(const std::string &name);
+
+  //! Create the extractor registered under name and fill info (NULL pointer if it does not exist).
+  //! If quantize, extractors supporting it produce uint8 descriptors (see DescriptorInfo)
+  static cv::Ptr< cv::DescriptorExtractor > createExtractor(const std::string &name,
+                                                            DescriptorInfo &info, bool quantize);
+
+  //! Create the fused detector and extractor of a pair (NULL pointer if the pair cannot be fused)
+  static cv::Ptr< cv::Feature2D > createFeatures(const std::string &detector_name,
+                                                 const std::string &extractor_name);
+
+  //! Compute the descriptors of keypoints with the extractor, quantized if needed
+  static void compute(const cv::Mat &image, std::vector< cv::KeyPoint > &keypoints, cv::Mat &descriptors);
+
+  //! Detect keypoints in the non-zero pixels of mask (whole image if empty) and describe them in
+  //! a single pass, quantized if needed. Only available if fused()
+  static void detectAndCompute(const cv::Mat &image, const cv::Mat &mask, std::vector< cv::KeyPoint > &keypoints,
+                               cv::Mat &descriptors);
+
+  //! \return descriptors in a type FLANN can index (float copy of quantized descriptors).
+  //! The returned matrix must outlive the index built on it
+  static cv::Mat indexable(const cv::Mat &descriptors);
+
+  //! \return a FLANN index of descriptors returned by indexable(): KD-trees or LSH
+  static cv::Ptr< cv::flann::Index > createIndex(const cv::Mat &indexed);
+
+  //! \return a FLANN matcher with an index suited to the descriptor type
+  static cv::Ptr< cv::DescriptorMatcher > createMatcher();
+
+  //! Find the nearest train descriptor of each query descriptor (brute force or FLANN)
+  static void match(const cv::Mat &query, const cv::Mat &train, std::vector< cv::DMatch > &matches);
+
+  //! Find the k nearest train descriptors of each query descriptor, sorted by distance (brute force or FLANN)
+  //! Rows with query_valid[i] == 0 get no neighbour, rows with train_valid[j] == 0 are not searched (all if NULL)
+  static void knnMatch(const cv::Mat &query, const cv::Mat &train, std::vector< std::vector< cv::DMatch > > &matches,
+                       int k, const std::vector< char > *query_valid = NULL,
+                       const std::vector< char > *train_valid = NULL);
+
+  static const cv::FeatureDetector &detector();
+  static const cv::DescriptorExtractor &extractor();
+  static const DescriptorInfo &descriptor();
+
+  static std::string detector_name();
+  static std::string extractor_name();
+  static int descriptor_size();
+  static int descriptor_type();
+  static int norm_type();
+  static double dist_threshold();
+  static bool is_binary(); //!< true if descriptors are compared with the Hamming distance
+  static bool brute_force(); //!< true if descriptors are matched by brute force instead of FLANN
+  static bool fused();       //!< true if keypoints can be detected and described in a single pass
+
+  //! \return the names and the parameters of the detector and the extractor (the same string as long
+  //! as they produce the same keypoints and descriptors)
+  static std::string parameters();
+};
+
+#endif /* ucl_drone_FEATURE_TYPES_H */
@@ -0,0 +1,56 @@
+/*!
+ *  \file grid_detector.h
+ *  \brief Keypoint detection on a grid of tiles processed in parallel
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  The image is split into grid_rows x grid_cols cells. Each cell is detected on its own
+ *  thread, on a tile enlarged by grid_overlap pixels so that the detector sees the
+ *  neighbourhood of the cell borders. Only the grid_max_per_cell strongest keypoints of
+ *  each cell are kept: keypoints are evenly spread and their number is bounded.
+ *
+ *  Parameters of the computer_vision node (see launch/components/slam.xml):
+ *  grid_detection, grid_rows, grid_cols, grid_overlap, grid_max_per_cell
+ */
+
+#ifndef ucl_drone_GRID_DETECTOR_H
+#define ucl_drone_GRID_DETECTOR_H
+
+#include <ros/ros.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+/** \class GridDetector
+ *  This class detects keypoints cell by cell with the detector selected in FeatureTypes
+ */
+class GridDetector
+{
+private:
+  static bool _enabled;
+  static int _rows;
+  static int _cols;
+  static int _overlap;
+  static int _max_per_cell;
+
+public:
+  //! Read the grid parameters in the private namespace of the node
+  static void init();
+
+  /**
+   * Detect keypoints in each cell of the grid, in parallel.
+   * @param[in] image image in which keypoints are detected
+   * @param[out] keypoints at most grid_max_per_cell keypoints per cell, sorted by cell
+   * @param[in] mask detection is restricted to its non-zero pixels (ignored if empty)
+   */
+  static void detect(const cv::Mat &image, std::vector< cv::KeyPoint > &keypoints,
+                     const cv::Mat &mask = cv::Mat());
+
+  static bool enabled();
+  static int rows();
+  static int cols();
+  static int overlap();
+  static int max_per_cell();
+};
+
+#endif /* ucl_drone_GRID_DETECTOR_H */
@@ -8,6 +8,11 @@
  *        - topics definitions
  *        - subscribers/publishers
  *        - all the calls to other classes
+ *
+ *  With the parameter `cameras` (e.g. [front, bottom]), one ImageProcessor per camera runs on its
+ *  own thread. Parameters are read in ~<camera>/ first, then in ~. The first camera publishes
+ *  processed_image, the other ones <camera>/processed_image. The detector, the extractor and the
+ *  targets are shared.
  */
 
 #ifndef ucl_drone_IMAGE_PROCESSOR_H
@@ -15,9 +20,13 @@
 
 #include <ucl_drone/profiling.h>
 
+#include <boost/bind.hpp>
+#include <boost/make_shared.hpp>
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/thread.hpp>
 
 // ROS Header files
+#include <ros/callback_queue.h>
 #include <ros/package.h>
 #include <ros/ros.h>
 
@@ -40,22 +49,59 @@
 // messages
 #include <ardrone_autonomy/CamSelect.h>
 #include <ardrone_autonomy/Navdata.h>
+#include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/image_encodings.h>
 #include <std_msgs/Empty.h>
+#include <std_msgs/UInt32.h>
 #include <std_srvs/Empty.h>
+#include <ucl_drone/ModeDecision.h>
 #include <ucl_drone/Pose3D.h>
 #include <ucl_drone/ProcessedImageMsg.h>
-#include <ucl_drone/KeyPoint.h>
+#include <ucl_drone/TargetsMsg.h>
 
 // ucl_drone
 #include <ucl_drone/opencv_utils.h>
 #include <ucl_drone/map/projection_2D.h>
-#include <ucl_drone/computer_vision/target.h>
+#include <ucl_drone/computer_vision/target_set.h>
 #include <ucl_drone/computer_vision/processed_image.h>
-#include <ucl_drone/constants/feature_types.h>
+#include <ucl_drone/computer_vision/feature_types.h>
+#include <ucl_drone/computer_vision/bounded_queue.h>
+#include <ucl_drone/computer_vision/mode_scheduler.h>
+#include <ucl_drone/computer_vision/rectifier.h>
 
 #include <ucl_drone/read_from_launch.h>
 
+/** \struct PipelineItem
+ * Image travelling through the stages of the pipeline (see ImageProcessor::use_pipeline)
+ */
+struct PipelineItem
+{
+  sensor_msgs::Image::ConstPtr image_msg;  //!< image received from the camera
+  ucl_drone::Pose3D::ConstPtr  pose_msg;   //!< last pose received with this image
+  boost::shared_ptr<ProcessedImage> img;   //!< image being processed
+  boost::shared_ptr<ProcessedImage> prev;  //!< previous image, until descriptors are copied and targets tracked
+  ucl_drone::ProcessedImageMsg::Ptr msg;   //!< message to be published
+  ros::WallTime start;                     //!< time when the image entered the pipeline
+  int OF_mode;                             //!< keypoints mode chosen by the scheduler
+  std::string mode_reason;                 //!< why OF_mode was chosen
+  bool made_full_detection;                //!< true if a full detection was made
+};
+typedef boost::shared_ptr<PipelineItem> PipelineItemPtr;
+
+/** \struct TargetJob
+ * Copy of a processed image in which the targets are searched asynchronously (see ImageProcessor::targetWorker)
+ */
+struct TargetJob
+{
+  std_msgs::Header header;              //!< header of the processed image
+  ucl_drone::Pose3D pose;               //!< pose of the processed image
+  std::vector<cv::KeyPoint> keypoints;  //!< described keypoints
+  cv::Mat descriptors;                  //!< their descriptors
+  cv::Mat gray;                         //!< grayscale image
+  std::vector<cv::Mat> pyramid;         //!< optical flow pyramid of gray, built by the worker
+};
+typedef boost::shared_ptr<TargetJob> TargetJobPtr;
+
 
 /** \class  ImageProcessor
  * Class of the image processor node for ROS.
@@ -65,9 +111,28 @@
 class ImageProcessor
 {
 private:
+  std::string cam_name;                  //!< Name of the camera (empty if the node has a single camera)
+  ros::CallbackQueue callback_queue;     //!< Callbacks of this camera (called by run)
   ros::NodeHandle nh;                    //!< Node handle (used by ROS)
+  ros::NodeHandle out_nh;                //!< Node handle in the namespace of the output topics
   image_transport::ImageTransport it;
 
+  //! Read a parameter of this camera (~<cam_name>/name), or of the node (~name) if it is not set
+  template < class T >
+  bool getParam(const std::string& name, T& value)
+  {
+    if (!cam_name.empty() && ros::param::get("~" + cam_name + "/" + name, value))
+      return true;
+    return ros::param::get("~" + name, value);
+  }
+
+  //! Read a parameter of this camera only (~<cam_name>/name, or ~name if the camera has no name)
+  template < class T >
+  bool getCameraParam(const std::string& name, T& value)
+  {
+    return ros::param::get("~" + (cam_name.empty() ? name : cam_name + "/" + name), value);
+  }
+
   // Subscribers
   std::string     video_channel;             //!< Channel for input video
   image_transport::Subscriber image_sub;     //!< Subscriber to input video
@@ -81,18 +146,120 @@ private:
   // Publishers
   std::string processed_image_channel_out; //!< Channel for processed images
   ros::Publisher processed_image_pub;      //!< Publisher of processed images
+  std::string dropped_frames_channel_out;  //!< Channel for the number of images dropped
+  ros::Publisher dropped_frames_pub;       //!< Publisher of the number of images dropped
+  std::string image_channel_out;            //!< Channel for the images referenced by processed images
+  ros::Publisher image_pub;                 //!< Publisher of the referenced images (latched)
+  std::string compressed_image_channel_out; //!< Channel for the compressed referenced images
+  ros::Publisher compressed_image_pub;      //!< Publisher of the compressed referenced images (latched)
+  std::string targets_channel_out;          //!< Channel for the targets searched asynchronously
+  ros::Publisher targets_pub;               //!< Publisher of the targets searched asynchronously
+  std::string scheduler_channel_out;        //!< Channel for the decisions of the keypoints mode scheduler
+  ros::Publisher scheduler_pub;             //!< Publisher of the decisions of the keypoints mode scheduler
+
+  // Event-driven processing (see processNextImage)
+  boost::mutex image_mutex;             //!< protects the last image and pose received, new_image and dropped_frames
+  boost::condition_variable image_cond; //!< signaled when a new image is received
+  bool new_image;                       //!< true if lastImageReceived has not been processed yet
+  unsigned dropped_frames;              //!< number of images replaced by a newer one before being processed
+  unsigned dropped_frames_total;        //!< number of images dropped since the node started (published)
+  double max_frame_age;                 //!< launch parameter: images older than this (in seconds) are dropped (<= 0: never)
+
+  ModeScheduler scheduler; //!< chooses the keypoints mode of each image within the latency budget
+  Rectifier rectifier;     //!< undistorts and rescales raw images (if the launch parameter camera_info is set)
 
-  ros::Time last_full_detection;   //!< Time when we last used detection on entire image
-  ros::Time last_hybrid_detection; //!< Time when we last used hybrid detection/tracking
+  // Serial processing: two slots used alternately, so that images are processed in reused buffers
+  ProcessedImage cam_img_slots[2]; //!< the last image processed and the one being processed
+  int prev_slot;                   //!< index of the last image processed in cam_img_slots
 
-  ProcessedImage* prev_cam_img; //!< the last image processed
+  // Pipeline: decode/resize -> track/detect -> describe -> target -> publish, one thread per stage
+  static const int pipeline_queue_size = 2;        //!< max number of images waiting between two stages
+  boost::thread_group pipeline_threads;            //!< threads running the stages of the pipeline
+  BoundedQueue<PipelineItemPtr> decode_queue;      //!< images to convert and rescale
+  BoundedQueue<PipelineItemPtr> track_queue;       //!< images whose keypoints have to be tracked/detected
+  BoundedQueue<PipelineItemPtr> describe_queue;    //!< images whose keypoints have to be described
+  BoundedQueue<PipelineItemPtr> target_queue;      //!< images in which the target has to be detected
+  BoundedQueue<PipelineItemPtr> publish_queue;     //!< messages to publish
+  boost::shared_ptr<ProcessedImage> pipeline_prev; //!< last image whose keypoints were found (track stage)
+  std::vector<ProcessedImage*> free_slots;         //!< processed images no longer used, ready to be reused
+  boost::mutex slots_mutex;                        //!< protects free_slots
+  sensor_msgs::Image::ConstPtr last_image_queued;  //!< last image given to the pipeline
+  boost::mutex reset_mutex;                        //!< protects prev_reset
+  bool prev_reset;                                 //!< true when the previous image has to be forgotten (pose reset)
 
+  // Asynchronous target detection: the latest image is given to a worker at most target_rate times per second
+  boost::thread target_thread;           //!< thread running targetWorker
+  boost::mutex target_mutex;             //!< protects target_job, next_target_time, target_areas and target_stop
+  boost::condition_variable target_cond; //!< signaled when a job is given to the worker
+  TargetJobPtr target_job;               //!< image waiting for the worker (replaced by newer ones)
+  ros::WallTime next_target_time;        //!< no image is given to the worker before this time
+  std::vector<std::vector<cv::Point2f> > target_areas; //!< corners and center of the targets last detected
+  bool target_stop;                      //!< true when the worker has to stop
+
+  //! Give a copy of img to the target worker, if it is time to search the targets again
+  void submitTargets(const ProcessedImage& img);
+  //! Search the targets in the images submitted and publish them (thread)
+  void targetWorker();
+
+ /**
+  * Build the message of a processed image: the targets are searched now, or
+  * asynchronously (the keypoints in the areas of the last targets detected are then removed)
+  */
+  void buildMsg(ucl_drone::ProcessedImageMsg::Ptr& msg, ProcessedImage& img, const ProcessedImage& prev);
+
+  void startPipeline(); //!< Launch one thread per stage
+  void stopPipeline();  //!< Close the queues and wait for the threads
+  void decodeStage();   //!< Stage 1: convert and rescale images
+  void trackStage();    //!< Stage 2: track and detect keypoints
+  void describeStage(); //!< Stage 3: compute keypoints descriptors
+  void targetStage();   //!< Stage 4: detect the target and build the message
+  void publishStage();  //!< Stage 5: publish the message
+
+  //! \return a ProcessedImage taken from free_slots (or a new one), given back when its last owner releases it
+  boost::shared_ptr<ProcessedImage> acquireSlot();
+  //! Give back a ProcessedImage to free_slots (deleter of the pointers returned by acquireSlot)
+  void releaseSlot(ProcessedImage* slot);
+
+ /**
+  * Process an image and publish the result (or give it to the pipeline).
+  * @param[in] image_msg Image received
+  * @param[in] pose_msg  Last pose received
+  */
+  void processImage(const sensor_msgs::Image::ConstPtr& image_msg, const ucl_drone::Pose3D::ConstPtr& pose_msg);
+
+  //! Count images dropped and publish the total
+  void countDroppedFrames(unsigned n);
+
+ /**
+  * Give the processing time of an image to the scheduler and publish its decision.
+  * @param[in] OF_mode Mode chosen for img
+  * @param[in] reason  Why OF_mode was chosen
+  * @param[in] img     The processed image
+  * @param[in] made_full_detection True if a full detection was made
+  * @param[in] start   Time when the processing of img started
+  */
+  void reportMode(int OF_mode, const std::string& reason, const ProcessedImage& img,
+                  bool made_full_detection, const ros::WallTime& start);
+
+ /**
+  * Give the image with its processed image message, as selected by image_payload:
+  * in the message (raw or compressed), or on the image topics if they have subscribers.
+  * @param[out] msg Message of the processed image
+  * @param[in]  img The processed image
+  */
+  void attachImage(ucl_drone::ProcessedImageMsg::Ptr& msg, const ProcessedImage& img);
 
   bool use_OpticalFlowPyrLK; //!< launch parameter: if true, processed_image has to use OpticalFlowPyrLK
-  bool target_loaded;        //!< true if the target is successfully loaded
+  bool use_pipeline;         //!< launch parameter: if true, stages of the image processing run on their own thread
+  int image_payload;         //!< launch parameter: image given with processed images (ProcessedImageMsg::IMAGE_*)
+  std::string image_format;  //!< launch parameter: format of compressed images ("jpeg" or "png")
+  int image_quality;         //!< launch parameter: JPEG quality or PNG compression level
+  bool async_targets;        //!< launch parameter: if true, targets are searched on their own thread and published apart
+  double target_rate;        //!< launch parameter: max rate of the asynchronous target detection [Hz] (<= 0: no limit)
+  bool target_loaded;        //!< true if at least one target is successfully loaded
   bool pending_reset;        //!< true during a reset
 
-  Target target; //<! the target to detect (this object wraps all needed procedures)
+  TargetSet targets; //<! the targets to detect (this object wraps all needed procedures)
 
   void setCamChannel(std::string cam_type);
 
@@ -116,8 +283,17 @@ private:
   sensor_msgs::Image::ConstPtr lastImageReceived; //!< the last Image message received
 
 public:
-  //! \brief Contructor.
-  ImageProcessor();
+  //! Build the detector and extractor and read the parameters shared by all cameras (call once, first)
+  static void initShared();
+
+ /**
+  * Contructor.
+  * @param[in] cam_name       Name of the camera (parameters in ~<cam_name>/), empty for a single camera
+  * @param[in] output_ns      Namespace of the output topics
+  * @param[in] shared_targets Targets loaded once for all cameras (NULL: loaded by this object)
+  */
+  ImageProcessor(const std::string& cam_name = "", const std::string& output_ns = "",
+                 const TargetSet* shared_targets = NULL);
 
   //! \brief Destructor.
   ~ImageProcessor();
@@ -128,8 +304,21 @@ public:
  */
   void publishProcessedImg();
 
+/**
+ * Wait for an image not processed yet and process it (event-driven mode).
+ * Images received while the previous one is processed are dropped, only the newest is kept.
+ */
+  void processNextImage();
+
+ /**
+  * Wait for the first pose and image, then process images until the node stops
+  * (at a fixed rate, or event-driven)
+  */
+  void run();
+
   bool pose_publishing;   //!< true after receiving the first pose3D message from pose_estimation
   bool video_publishing;  //!< true after receiving the first Image message from ardrone_autonomy
+  bool event_driven;      //!< launch parameter: if true, images are processed on arrival instead of at a fixed rate
 };
 
 #endif /*ucl_drone_IMAGE_PROCESSOR_H*/
@@ -0,0 +1,65 @@
+/*!
+ *  \file matching_engine.h
+ *  \brief Selection of descriptor matches: distance threshold, ratio test, cross-check,
+ *         uniqueness and budget
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  The k nearest neighbours of each query descriptor (brute force, FLANN, or the index of the map)
+ *  are filtered in the same way everywhere (map, keyframes and targets):
+ *   - the nearest train descriptor must be closer than max_distance,
+ *   - and clearly closer than the second one (ratio test),
+ *   - and, with cross_check, the query descriptor must be the nearest one of this train descriptor;
+ *  then the closest matches are kept first, each train descriptor at most once (bitmap), up to
+ *  max_matches.
+ */
+
+#ifndef ucl_drone_MATCHING_ENGINE_H
+#define ucl_drone_MATCHING_ENGINE_H
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+
+/** \struct MatchOptions
+ *  How matches are selected (see matching_engine.h)
+ */
+struct MatchOptions
+{
+  double max_distance; //!< Matches farther than this are rejected
+  double ratio;        //!< Nearest distance must be below ratio times the second one (<= 0: no ratio test)
+  bool cross_check;    //!< If true, the query must also be the nearest descriptor of its train descriptor
+  int max_matches;     //!< Max number of matches kept, the closest ones (negative: no limit)
+
+  MatchOptions(double max_distance, double ratio = 0, bool cross_check = false, int max_matches = -1)
+    : max_distance(max_distance), ratio(ratio), cross_check(cross_check), max_matches(max_matches)
+  {
+  }
+};
+
+/**
+ * Select matches among the nearest neighbours of each query descriptor.
+ * @param[in]  knn_matches Nearest train descriptors of each query descriptor, sorted by distance
+ *                         (at least 2 for the ratio test, a single one passes it)
+ * @param[in]  n_train     Number of train descriptors
+ * @param[in]  options     Selection of the matches
+ * @param[out] matches     Matches kept, sorted by distance (each query and train descriptor at most once)
+ * @param[in]  reverse     Nearest query descriptor of each train descriptor (needed for cross_check)
+ */
+void filterKnnMatches(const std::vector< std::vector< cv::DMatch > >& knn_matches, int n_train,
+                      const MatchOptions& options, std::vector< cv::DMatch >& matches,
+                      const std::vector< std::vector< cv::DMatch > >* reverse = NULL);
+
+/**
+ * Match two sets of descriptors (brute force or FLANN, see FeatureTypes) and select the matches.
+ * @param[in]  query       Query descriptors
+ * @param[in]  train       Train descriptors
+ * @param[in]  options     Selection of the matches
+ * @param[out] matches     Matches kept, sorted by distance (each query and train descriptor at most once)
+ * @param[in]  query_valid Query descriptors that can be matched, all if NULL
+ * @param[in]  train_valid Train descriptors that can be matched, all if NULL
+ */
+void matchUnique(const cv::Mat& query, const cv::Mat& train, const MatchOptions& options,
+                 std::vector< cv::DMatch >& matches, const std::vector< char >* query_valid = NULL,
+                 const std::vector< char >* train_valid = NULL);
+
+#endif /* ucl_drone_MATCHING_ENGINE_H */
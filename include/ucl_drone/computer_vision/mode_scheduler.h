@@ -0,0 +1,85 @@
+/*!
+ *  \file mode_scheduler.h
+ *  \brief Choice of the keypoints mode (tracking, hybrid or detection) within a latency budget
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  The time spent to find and describe keypoints is measured for each mode and averaged, as well
+ *  as the rest of the processing of an image. Tracking is used as long as the image keeps enough
+ *  keypoints. When keypoints are lost, or when no full detection was made for refresh_period
+ *  seconds, the richest mode whose expected latency fits in latency_budget is chosen.
+ *
+ *  Parameters of the computer_vision node (see launch/components/slam.xml):
+ *  latency_budget, refresh_period, min_keypoints, min_keypoints_ratio, cost_smoothing
+ */
+
+#ifndef ucl_drone_MODE_SCHEDULER_H
+#define ucl_drone_MODE_SCHEDULER_H
+
+#include <string>
+
+#include <boost/thread/mutex.hpp>
+
+#include <ros/ros.h>
+
+#include <ucl_drone/ModeDecision.h>
+#include <ucl_drone/computer_vision/processed_image.h>
+
+/** \class ModeScheduler
+ *  Choose the OF_mode of each image (see ProcessedImage::findKeypoints) from measured costs.
+ *  choose() and update() may be called from different threads (pipeline stages).
+ */
+class ModeScheduler
+{
+private:
+  double budget;              //!< launch parameter: expected processing time of an image [s]
+  double refresh_period;      //!< launch parameter: max time without full detection [s]
+  int min_keypoints;          //!< launch parameter: full detection below this number of keypoints
+  double min_keypoints_ratio; //!< launch parameter: a richer mode is chosen below this fraction of
+                              //!< the keypoints found by the last full detection
+  double smoothing;           //!< launch parameter: weight of a new measure in the averages
+
+  double mode_cost[3];       //!< average keypoints time of each mode (index OF_mode + 1), < 0 if unknown
+  double base_cost;          //!< average processing time besides keypoints, < 0 if unknown
+  int reference_pts;         //!< number of keypoints found by the last full detection
+  ros::Time last_detection;  //!< time of the last full detection
+  boost::mutex mutex;        //!< protects all the attributes
+
+  //! \return the expected latency of mode (0 if it was never measured, to try it)
+  double expected(int mode) const;
+
+  //! \return true if mode is expected to fit in the budget
+  bool fits(int mode) const;
+
+  //! Add a measure to an average
+  void average(double& avg, double measure) const;
+
+public:
+  //! Constructor.
+  ModeScheduler();
+
+  //! Read the parameters in the private namespace of the node (~<cam_name>/ first if cam_name is given)
+  void init(const std::string& cam_name = "");
+
+  /**
+   * Choose how keypoints are found in the next image.
+   * @param[in]  prev   Previous image processed
+   * @param[out] reason Why this mode is chosen
+   * @return OF_mode (see ModeDecision)
+   */
+  int choose(const ProcessedImage& prev, std::string& reason);
+
+  /**
+   * Measure the processing of an image.
+   * @param[in]  mode    Mode chosen for img
+   * @param[in]  reason  Why mode was chosen
+   * @param[in]  img     The processed image (with its keypoints_time)
+   * @param[in]  made_full_detection True if a full detection was made (whatever the mode)
+   * @param[in]  latency Processing time of the image [s]
+   * @param[out] msg     Decision and measures, to be published
+   */
+  void update(int mode, const std::string& reason, const ProcessedImage& img, bool made_full_detection,
+              double latency, ucl_drone::ModeDecision& msg);
+};
+
+#endif /* ucl_drone_MODE_SCHEDULER_H */
@@ -16,6 +16,7 @@
 #include <ucl_drone/profiling.h>
 
 #include <boost/shared_ptr.hpp>
+#include <boost/thread/mutex.hpp>
 
 // ROS Header files
 #include <ros/package.h>
@@ -40,19 +41,21 @@
 // messages
 #include <ardrone_autonomy/CamSelect.h>
 #include <ardrone_autonomy/Navdata.h>
+#include <sensor_msgs/CompressedImage.h>
 #include <sensor_msgs/image_encodings.h>
 #include <std_msgs/Empty.h>
 #include <std_srvs/Empty.h>
 #include <ucl_drone/Pose3D.h>
 #include <ucl_drone/ProcessedImageMsg.h>
-#include <ucl_drone/KeyPoint.h>
 
 // ucl_drone
 #include <ucl_drone/opencv_utils.h>
 #include <ucl_drone/map/projection_2D.h>
 #include <ucl_drone/computer_vision/processed_image.h>
-#include <ucl_drone/constants/feature_types.h>
-#include <ucl_drone/computer_vision/target.h>
+#include <ucl_drone/computer_vision/feature_types.h>
+#include <ucl_drone/computer_vision/grid_detector.h>
+#include <ucl_drone/computer_vision/rectifier.h>
+#include <ucl_drone/computer_vision/target_set.h>
 
 
 /*!
@@ -63,16 +66,45 @@ class ProcessedImage
 {
 private:
   static constexpr double border_detec_frac = 0.15; //!< Percentage threshold of border with no inliers
+  static const int of_win_size  = 21; //!< Size of the search window of the optical flow at each level
+  static const int of_max_level = 3;  //!< Number of pyramid levels used by the optical flow (0-based)
   ucl_drone::ProcessedImageMsg::Ptr msg;  //!< the message to be sent
+  static uint32_t next_track_id;          //!< track id given to the next keypoint detected
+  static boost::mutex track_id_mutex;     //!< protects next_track_id
+
+  //! \return the first of n new consecutive track ids
+  static uint32_t newTrackIds(int n);
+
+  //! Fill the header, the pose and the descriptor format of msg
+  void fillHeader(ucl_drone::ProcessedImageMsg::Ptr& msg) const;
+
+  //! Copy keypoints, descriptors and tracks in msg, except the sorted indexes idxs_to_remove
+  void fillKeypoints(ucl_drone::ProcessedImageMsg::Ptr& msg, const std::vector< cv::KeyPoint >& keypoints,
+                     const cv::Mat& descriptors, const std::vector< uint32_t >& track_ids,
+                     const std::vector< int >& idxs_to_remove) const;
 
 public:
   cv_bridge::CvImagePtr cv_img;        //!< Image in OpenCV format
-  std::vector<cv::KeyPoint> keypoints; //!< vector of keypoints detected
-  cv::Mat descriptors;                 //!< the keypoints descripors in opencv format
-  sensor_msgs::Image image;            //!< video image in the ROS format after rescaling
+  std::vector<cv::KeyPoint> keypoints; //!< vector of keypoints found (tracked ones first, then detected ones)
+  std::vector<int> prev_indices;       //!< index in the previous image of each tracked keypoint (-1 if detected)
+  std::vector<uint32_t> track_ids;     //!< track of each keypoint, kept while it is tracked from image to image
+  cv::Mat descriptors;                 //!< the keypoints descripors in opencv format (one row per keypoint)
+  std::vector<uchar> has_descriptor;   //!< 0 for keypoints the extractor could not describe
+  cv::Mat detected_descriptors;        //!< descriptors of the detected keypoints, if computed with them
+  bool detected_described;             //!< true if detected_descriptors is filled (see FeatureTypes::fused)
+  cv::Mat gray;                        //!< grayscale image, built for the optical flow
+  std::vector<cv::Mat> of_pyramid;     //!< optical flow pyramid of gray, reused when the next image is tracked
+  bool has_pyramid;                    //!< true if of_pyramid was built for the current image
   ucl_drone::Pose3D pose;            //!< estimated pose of the drone before the visual estimation
 
-  int n_pts;    //!< the number of keypoints detected in the last image
+  int n_pts;       //!< the number of keypoints found in the last image
+  int n_tracked;   //!< the number of keypoints obtained by tracking
+  int n_described; //!< the number of keypoints with a descriptor
+  double keypoints_time; //!< time spent to find and describe the keypoints [s] (see ModeScheduler)
+
+  static double min_tracked_ratio; //!< tracking fails below this fraction of the keypoints of the previous image
+  static int min_tracked;          //!< tracking fails below this number of keypoints
+  static bool mono;                //!< images are converted to MONO8 instead of BGR8 when received
 
   //Constructors
   /**
@@ -80,6 +112,15 @@ public:
    */
   ProcessedImage();
 
+ /**
+  * Constructor.
+  * Create a ProcessImage object from an image message, without looking for keypoints yet
+  * (first stage of the pipeline, see findKeypoints and describeKeypoints)
+  * @param[in]  msg                 Image to be processed.
+  * @param[in]  pose                Estimation of the pose at the moment the image was observed.
+  */
+  ProcessedImage(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose);
+
  /**
   * Constructor.
   * Create a ProcessImage object from an image message, and extract keypoints
@@ -91,29 +132,74 @@ public:
   */
   ProcessedImage(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose, ProcessedImage& prev, int OF_mode, bool& made_full_detection);
 
+ /**
+  * Process a new image in this object, reusing the buffers of the image it held before
+  * (same as the constructor above, without allocation once the buffers have the right size).
+  * @param[in] rectifier Undistorts and rescales the image (NULL: the image is only rescaled)
+  * @return false if the image could not be converted
+  */
+  bool process(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose, ProcessedImage& prev, int OF_mode, bool& made_full_detection,
+               const Rectifier* rectifier = NULL);
+
+ /**
+  * Forget the image held by this object (it then behaves as an empty ProcessedImage).
+  */
+  void clear();
+
+ /**
+  * Convert the image message to OpenCV format and rescale it, undistorted in the same
+  * pass if a rectifier is given (see Rectifier).
+  * The previous content of this object is overwritten, its buffers are reused.
+  * @param[in] rectifier Undistorts and rescales the image (NULL: the image is only rescaled)
+  * @return false if the image could not be converted
+  */
+  bool convertImage(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose, const Rectifier* rectifier = NULL);
+
+ /**
+  * Find the keypoints of this image (without describing them), by tracking and/or detection.
+  * Only reads keypoints and image of prev, so prev may still be described concurrently.
+  * @param[in]  prev                Previous ProcessedImage.
+  * @param[in]  OF_mode             Optical Flow mode. 1 = Use only tracking. 0 = use hybrid. -1 = Use only detection
+  * @param[out] made_full_detection True if full detection (on entire image was used)
+  */
+  void findKeypoints(ProcessedImage& prev, int OF_mode, bool& made_full_detection);
+
+ /**
+  * Compute the descriptors of the keypoints found by findKeypoints.
+  * Tracked keypoints keep their descriptor from prev, detected keypoints are described by the extractor.
+  * @param[in]  prev                Previous ProcessedImage (must already be described).
+  */
+  void describeKeypoints(const ProcessedImage& prev);
+
+ /**
+  * Build the grayscale image and its optical flow pyramid, if they do not exist yet.
+  * They are kept so that tracking the next image only builds the pyramid of the new image.
+  */
+  void buildPyramid();
+
 
  /**
   * Find keypoints using tracking.
   * Find keypoints present by looking for keypoints from the previous image using an optical flow method
-  * @param[out] tracked_descriptors Descriptors of tracked keypoints.
   * @param[out] tracked_keypoints   Tracked keypoints (2D coordinates in this image).
+  * @param[out] tracked_indices     Index of each tracked keypoint in the previous image.
   * @param[in]  prev                Pointer to previous ProcessedImage.
   * @param[out] min_x Leftmost x-position of tracked keypoints
   * @param[out] max_x Rightmost x-position of tracked keypoints
   * @param[out] min_y Highest y-position of tracked keypoints
   * @param[out] max_y Lowest y-position of tracked keypoints
   */
-  bool trackKeypoints(cv::Mat& tracked_descriptors, std::vector<cv::KeyPoint>& tracked_keypoints,
+  bool trackKeypoints(std::vector<cv::KeyPoint>& tracked_keypoints, std::vector<int>& tracked_indices,
     ProcessedImage& prev,  int& min_x, int& max_x, int& min_y, int& max_y);
  /**
-  * Find keypoints using detection and descriptor extraction.
-  * Detect keypoints in the image using a detector, and then extract a descriptor for these points
-  * @param[out] detected_descriptors Descriptors of detected keypoints.
+  * Find keypoints using detection.
+  * Detect keypoints in the image using a detector (they are described later by describeKeypoints).
+  * With a fused detector and extractor, they are described at once in detected_descriptors.
   * @param[out] detected_keypoints   Detected keypoints (2D coordinates in this image).
   * @param[in]  full_detection       If true, disregard mask and perform detection on entire image.
   * @param[in]  mask                 Mask specifying what part of the image to search for detectors.
   */
-  void detectKeypoints(cv::Mat& detected_descriptors, std::vector<cv::KeyPoint>& detected_keypoints, bool full_detection, cv::Mat& mask);
+  void detectKeypoints(std::vector<cv::KeyPoint>& detected_keypoints, bool full_detection, cv::Mat& mask);
 
  /**
   * Combine detected and tracked keypoints.
@@ -129,8 +215,41 @@ public:
 
   ~ProcessedImage(); //!< Destructor
 
-  //!< build a message that can be sent to other nodes
-  void convertToMsg(ucl_drone::ProcessedImageMsg::Ptr& msg, Target target);
+ /**
+  * Build a message that can be sent to other nodes, with the targets detected in this image
+  * @param[out] msg     the message
+  * @param[in]  targets the targets to detect
+  * @param[in]  prev    the image processed before this one (targets are tracked from it)
+  */
+  void convertToMsg(ucl_drone::ProcessedImageMsg::Ptr& msg, TargetSet& targets, const ProcessedImage& prev);
+
+ /**
+  * Build a message that can be sent to other nodes, without searching the targets
+  * (they are searched asynchronously, see ImageProcessor::targetWorker)
+  * @param[out] msg          the message
+  * @param[in]  target_areas corners and center of the targets where they were last detected (keypoints inside are not sent)
+  */
+  void convertToMsg(ucl_drone::ProcessedImageMsg::Ptr& msg,
+                    const std::vector< std::vector< cv::Point2f > >& target_areas);
+
+  //! Copy the described keypoints, their descriptors and tracks (nothing if all keypoints are described)
+  void selectDescribed(std::vector< cv::KeyPoint >& described_keypoints, cv::Mat& described_descriptors,
+                       std::vector< uint32_t >& described_track_ids) const;
+
+ /**
+  * Convert the rescaled image to the ROS format (only done for the nodes which need the pixels)
+  * @param[out] image_msg the image in BGR8 (MONO8 if mono)
+  */
+  void toImageMsg(sensor_msgs::Image& image_msg) const;
+
+ /**
+  * Compress the rescaled image
+  * @param[out] image_msg the compressed image
+  * @param[in]  format    "jpeg" or "png"
+  * @param[in]  quality   JPEG quality (0-100) or PNG compression level (0-9)
+  * @return false if the image could not be encoded
+  */
+  bool toCompressedImageMsg(sensor_msgs::CompressedImage& image_msg, const std::string& format, int quality) const;
 };
 
 #endif /*ucl_drone_PROCESSED_IMAGE_H*/
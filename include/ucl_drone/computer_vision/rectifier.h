@@ -0,0 +1,59 @@
+/*!
+ *  \file rectifier.h
+ *  \brief Undistortion and rescaling of the camera images in a single remap
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  The calibration of the camera (camera_info/ardrone_front.yaml, written by camera_calibration)
+ *  gives the distortion of the raw images and the camera matrix of the rectified ones. The
+ *  rectified camera matrix is rescaled to the size of the processed images (img_size in
+ *  launch/components/global_params.xml), so that one remap table undistorts and resizes at once:
+ *  raw images are processed without the image_proc node and without an extra resize.
+ *
+ *  Parameter of the computer_vision node (see launch/components/slam.xml): camera_info
+ */
+
+#ifndef ucl_drone_RECTIFIER_H
+#define ucl_drone_RECTIFIER_H
+
+#include <ros/ros.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/imgproc/imgproc.hpp>
+
+/** \class Rectifier
+ *  This class maps raw images of a calibrated camera to rectified images of the processed size
+ */
+class Rectifier
+{
+private:
+  cv::Size raw_size;        //!< size of the raw images, as calibrated
+  cv::Size size;            //!< size of the rectified images
+  cv::Mat map1;             //!< remap table: fixed-point coordinates in the raw image (CV_16SC2)
+  cv::Mat map2;             //!< remap table: interpolation coefficients (CV_16UC1)
+
+public:
+  //! Constructor (no rectification until init succeeds)
+  Rectifier();
+
+  /**
+   * Build the remap table from a calibration file.
+   * @param[in] calibration_file Path of the camera calibration (YAML or INI)
+   * @param[in] size             Size of the rectified images
+   * @return false if the file cannot be read, the remap table is then empty
+   */
+  bool init(const std::string& calibration_file, const cv::Size& size);
+
+  //! \return true if the remap table is built
+  bool enabled() const;
+
+  /**
+   * Undistort and rescale a raw image.
+   * @param[in]  raw   Raw image (any type supported by cv::remap)
+   * @param[out] image Rectified image, must not share its data with raw
+   * @return false if raw does not have the calibrated size (image is then untouched)
+   */
+  bool apply(const cv::Mat& raw, cv::Mat& image) const;
+};
+
+#endif /* ucl_drone_RECTIFIER_H */
@@ -25,6 +25,7 @@
 #include <image_transport/image_transport.h>
 #include <opencv2/calib3d/calib3d.hpp>
 #include <opencv2/core/core.hpp>
+#include <opencv2/flann/flann.hpp>
 #include <opencv2/highgui/highgui.hpp>
 #include <opencv2/imgproc/imgproc.hpp>
 #include <opencv2/nonfree/features2d.hpp>
@@ -42,22 +43,29 @@
 #include <std_srvs/Empty.h>
 #include <ucl_drone/Pose3D.h>
 #include <ucl_drone/ProcessedImageMsg.h>
-#include <ucl_drone/KeyPoint.h>
 
-#include <ucl_drone/constants/feature_types.h>
+#include <ucl_drone/computer_vision/feature_types.h>
+#include <ucl_drone/computer_vision/matching_engine.h>
 
 
 //! Filename to the target from within the package
 static const std::string TARGET_RELPATH = "/target/target_bottom.png";
 
+//! A match is kept if its distance is below this ratio times the distance of the second best match
+static const double TARGET_MATCH_RATIO = 0.8;
+
+//! A match is kept if its distance is below this fraction of the descriptor distance threshold
+static const double TARGET_MATCH_DIST = 0.75;
+
+//! \return a hash (FNV-1a, hexadecimal) of the elements of data, to detect outdated caches
+std::string contentHash(const cv::Mat& data);
+
 #ifdef DEBUG_TARGET
 static const std::string OPENCV_WINDOW = "Object matches";
 #endif
 
 // #define DEBUG_TARGET // if defined a window with target matches is displayed
 
-// #define DEBUG_PROJECTION  // if defined print relative errors of projection for the target
-
 /*!
  *  \class Target
  *  \brief Provide tools to track the presence of a target
@@ -70,8 +78,13 @@ private:
   cv::Mat descriptors;                   //! target keypoints descriptors
   std::vector<cv::Point2f> centerAndCorners;  //! position of the center and the corners of the
                                               //! target
-  cv::FlannBasedMatcher matcher;  //! wrapper object to the FLANN library to perform matching with
-                                  //! the video pictures
+  std::string name;  //! file name of the target picture
+
+  //! Load keypoints and descriptors saved by a previous run (with the same features)
+  bool loadFeatures(const std::string& path);
+
+  //! Save keypoints and descriptors next to the picture
+  void saveFeatures(const std::string& path);
 
 public:
   //! Constructor
@@ -81,39 +94,52 @@ public:
   ~Target();
 
   //! initializer
+  //! The target features are cached in a file next to the picture (named after the picture and
+  //! the detector/extractor), so that later runs skip their computation.
+  //! Their index is built by the TargetSet, for all targets at once.
   bool init(const std::string relative_path);
 
-  //! This method detects the target in a given picture
-  //! \param[in] cam_descriptors The desciptors of keypoints in camera picture
+  //! \return the target keypoints descriptors
+  const cv::Mat& get_descriptors() const { return descriptors; }
+
+  //! \return the keypoints detected on the target picture
+  const std::vector< cv::KeyPoint >& get_keypoints() const { return keypoints; }
+
+  //! \return the file name of the target picture
+  const std::string& get_name() const { return name; }
+
+  //! This method decides if the target is detected from its good matches, and locates it
   //! \param[in] cam_keypoints The coordinates of keypoints in camera picture
-  //! \param[out] good_matches The good matches between the target picture and the camera picture,
-  //! in OpenCV format
-  //! \param[out] idxs_to_remove A list of indexes of keypoints on the target
+  //! \param[in] good_matches The good matches (queryIdx: target keypoint, trainIdx: camera keypoint)
+  //! \param[out] idxs_to_remove Indexes of camera keypoints lying on the target (appended, unsorted)
   //! \param[out] target_coord The coordinates if the target is detected
-  //! \param[in] pose (#ifdef DEBUG_PROJECTION) Pose of the drone estimated with
-  //! \param[in] image_cam (#ifdef DEBUG_TARGET) image matrix (OpenCV format)
+  //! \param[out] inliers If not NULL, inliers of the homography (one per good match)
   //! \return true if the target is detected
-  bool detect(cv::Mat cam_descriptors, std::vector< cv::KeyPoint >& cam_keypoints,
-              std::vector< cv::DMatch >& good_matches, std::vector< int >& idxs_to_remove,
-              std::vector< cv::Point2f >& target_coord
-#ifdef DEBUG_PROJECTION
-              ,
-              ucl_drone::Pose3D pose
-#endif
-#ifdef DEBUG_TARGET
-              ,
-              cv::Mat& image_cam
-#endif
-              );
+  bool locate(const std::vector< cv::KeyPoint >& cam_keypoints,
+              const std::vector< cv::DMatch >& good_matches, std::vector< int >& idxs_to_remove,
+              std::vector< cv::Point2f >& target_coord, std::vector< uchar >* inliers = NULL) const;
+
+  //! This method computes the corners and center of the target on the camera image
+  //! \param[in] H Homography from the target picture to the camera picture
+  //! \param[out] coord The coordinates of the corners and center
+  void project(const cv::Mat& H, std::vector< cv::Point2f >& coord) const;
+
+  //! This method lists the camera keypoints lying inside the target
+  //! \param[in] target_coord The corners and center of the target on the camera picture
+  //! \param[in] cam_keypoints The coordinates of keypoints in camera picture
+  //! \param[out] idxs Indexes of camera keypoints inside the target (appended, unsorted)
+  static void keypointsInside(const std::vector< cv::Point2f >& target_coord,
+                              const std::vector< cv::KeyPoint >& cam_keypoints, std::vector< int >& idxs);
 
   //! This method draws a green frame to indicate the detected target
   //! \param[in] cam_img image matrix (OpenCV format)
   void draw(cv::Mat cam_img, std::vector< cv::KeyPoint > cam_keypoints,
-            std::vector< cv::DMatch > good_matches, cv::Mat& img_matches);
+            std::vector< cv::DMatch > good_matches, cv::Mat& img_matches) const;
 
   //! This method computes the position of the target on the camera image
-  void position(std::vector< cv::KeyPoint > cam_keypoints, std::vector< cv::DMatch > good_matches,
-                std::vector< cv::Point2f >& coord);
+  //! \return false if no homography could be found
+  bool position(const std::vector< cv::KeyPoint >& cam_keypoints, const std::vector< cv::DMatch >& good_matches,
+                std::vector< cv::Point2f >& coord, std::vector< uchar >* inliers = NULL) const;
 };
 
 bool customLess(cv::DMatch a, cv::DMatch b);
@@ -0,0 +1,124 @@
+/*!
+ *  \file target_set.h
+ *  \brief Header file for the TargetSet class which detects several predefined targets at once
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  Part of ucl_drone.
+ */
+
+#ifndef ucl_drone_TARGET_SET_H
+#define ucl_drone_TARGET_SET_H
+
+#include <boost/thread/mutex.hpp>
+
+#include <ucl_drone/computer_vision/target.h>
+
+//! A tracked target is lost when less points than this are still consistent with its homography
+static const int TARGET_TRACK_MIN_POINTS = 10;
+//! ... or when less than this fraction of the points found at detection remain
+static const double TARGET_TRACK_MIN_KEPT = 0.5;
+//! ... or when less than this fraction of the points found by optical flow fit the homography
+static const double TARGET_TRACK_MIN_INLIERS = 0.7;
+//! Optical flow window (must not exceed the window used to build the pyramids, see ProcessedImage)
+static const int TARGET_TRACK_WIN_SIZE = 21;
+//! Number of pyramid levels (0-based) built by the asynchronous target detection (see ImageProcessor)
+static const int TARGET_TRACK_MAX_LEVEL = 3;
+
+/** \struct TargetDetection
+ *  A target detected in a camera picture
+ */
+struct TargetDetection
+{
+  int target_id;                           //!< index of the target in the TargetSet
+  std::vector< cv::Point2f > target_coord; //!< corners and center of the target in the picture
+  std::vector< cv::DMatch > good_matches;  //!< matches (queryIdx: target keypoint, trainIdx: camera keypoint),
+                                           //!< empty if the target was tracked
+};
+
+/** \struct TargetTrack
+ *  A detected target followed by optical flow in the next pictures
+ */
+struct TargetTrack
+{
+  bool active;                              //!< true while the target is tracked
+  std::vector< cv::Point2f > target_points; //!< inliers of the homography, in the target picture
+  std::vector< cv::Point2f > image_points;  //!< the same points in the last camera picture
+  int initial_size;                         //!< number of points when the target was detected
+};
+
+/*!
+ *  \class TargetSet
+ *  \brief Detect several targets with a single descriptor search per picture.
+ *  The descriptors of all targets are stacked in one FLANN index, each row being tagged with
+ *  its target. The index is saved in the target directory and loaded by the next runs while the
+ *  targets and the features do not change. Camera descriptors are searched once in this index, then the matches are
+ *  split by target and each target is located with its own homography.
+ *  Once detected, a target is tracked: the inliers of its homography are followed by optical flow
+ *  and the homography is estimated from them only. The descriptor search is skipped while all
+ *  detected targets are tracked, and done again as soon as one of them is lost.
+ *  Copies of a TargetSet share the targets and the index, each copy tracks the targets on its own
+ *  (one copy per camera).
+ */
+class TargetSet
+{
+private:
+  std::vector< Target > targets;   //!< the targets, indexed by target ID
+  cv::Mat descriptors;             //!< descriptors of all targets, stacked
+  std::vector< int > row_target;   //!< target ID of each row of descriptors
+  std::vector< int > row_keypoint; //!< keypoint index in its target of each row of descriptors
+  cv::Ptr< cv::flann::Index > index; //!< FLANN index of descriptors
+  cv::Mat indexed_descriptors;       //!< descriptors as stored in the index (float if quantized)
+  boost::shared_ptr< boost::mutex > index_mutex; //!< serializes the searches in index (shared by the copies)
+  std::vector< TargetTrack > tracks; //!< tracking state of each target
+
+  //! Start tracking a target from the inliers of its detection
+  void startTrack(int target_id, const std::vector< cv::KeyPoint >& cam_keypoints,
+                  const std::vector< cv::DMatch >& good_matches, const std::vector< uchar >& inliers);
+
+  //! Follow a tracked target in the new picture
+  //! \return false if the target is lost
+  bool track(int target_id, const std::vector< cv::Mat >& prev_pyramid, const std::vector< cv::Mat >& pyramid,
+             const std::vector< cv::KeyPoint >& cam_keypoints, TargetDetection& detection,
+             std::vector< int >& idxs_to_remove);
+
+  //! Load the index of descriptors saved by a previous run (with the same descriptors)
+  bool loadIndex(const std::string& path);
+
+  //! Save the index of descriptors, with a hash of the descriptors to detect outdated indexes
+  void saveIndex(const std::string& path) const;
+
+public:
+  //! Constructor
+  TargetSet();
+
+  //! Load the targets and build (or load) the combined index
+  //! \param[in] relative_paths Filenames of the target pictures from within the package
+  //! \return true if at least one target is loaded
+  bool init(const std::vector< std::string >& relative_paths);
+
+  //! This method detects the targets in a given picture
+  //! \param[in] cam_descriptors The desciptors of keypoints in camera picture
+  //! \param[in] cam_keypoints The coordinates of keypoints in camera picture
+  //! \param[out] detections The targets detected
+  //! \param[out] idxs_to_remove Sorted indexes of camera keypoints lying on a detected target
+  //! \param[in] prev_pyramid Optical flow pyramid of the previous picture (empty: no tracking)
+  //! \param[in] pyramid Optical flow pyramid of this picture (empty: no tracking)
+  //! \return true if at least one target is detected
+  bool detect(const cv::Mat& cam_descriptors, const std::vector< cv::KeyPoint >& cam_keypoints,
+              std::vector< TargetDetection >& detections, std::vector< int >& idxs_to_remove,
+              const std::vector< cv::Mat >& prev_pyramid = std::vector< cv::Mat >(),
+              const std::vector< cv::Mat >& pyramid = std::vector< cv::Mat >());
+
+  //! Convert detections to messages (target name, corners and center)
+  void toMsg(const std::vector< TargetDetection >& detections,
+             std::vector< ucl_drone::TargetObservation >& observations) const;
+
+  //! \return the number of targets loaded
+  int size() const { return targets.size(); }
+
+  //! \return the target with the given ID
+  const Target& get_target(int target_id) const { return targets[target_id]; }
+};
+
+#endif /* ucl_drone_TARGET_SET_H */
@@ -0,0 +1,60 @@
+/*!
+ *  \file image_payload.h
+ *  \brief Access to the image of a ProcessedImageMsg, whatever its payload
+ *         (embedded, compressed or published by reference)
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  The computer vision node only sends the pixels to the nodes which need them (see the
+ *  `image_payload` parameter of computer_vision). With IMAGE_REFERENCE, the images are published
+ *  on processed_image/image and this class subscribes to that topic the first time it needs it.
+ */
+
+#ifndef ucl_drone_IMAGE_PAYLOAD_H
+#define ucl_drone_IMAGE_PAYLOAD_H
+
+#include <deque>
+
+#include <ros/ros.h>
+
+#include <cv_bridge/cv_bridge.h>
+#include <opencv2/core/core.hpp>
+#include <opencv2/highgui/highgui.hpp>
+#include <sensor_msgs/image_encodings.h>
+#include <ucl_drone/ProcessedImageMsg.h>
+
+/** \class ImagePayload
+ *  Give the image of processed images (BGR8, or MONO8 in mono mode), decoding it or waiting for it on the image topic
+ */
+class ImagePayload
+{
+private:
+  static const unsigned max_images = 10; //!< number of referenced images kept
+
+  ros::NodeHandle nh;
+  std::string image_channel;                           //!< topic of the referenced images
+  ros::Subscriber image_sub;                           //!< subscribed when the first reference is received
+  std::deque< sensor_msgs::Image::ConstPtr > images;   //!< last referenced images received
+
+  //! \brief Callback when a referenced image is received
+  void imageCb(const sensor_msgs::Image::ConstPtr& msg);
+
+public:
+  //! Constructor. \param[in] processed_image_channel topic of the processed images
+  ImagePayload(const std::string& processed_image_channel);
+
+  //! Destructor.
+  ~ImagePayload();
+
+  /**
+   * Get the image of a processed image.
+   * @param[in]  msg      the processed image
+   * @param[out] image    the image (not modified if it is not available)
+   * @param[in]  encoding encoding of image, empty to keep the one of the computer vision node (BGR8 or MONO8)
+   * @return false if msg has no image, or if a referenced image is not received (yet)
+   */
+  bool getImage(const ucl_drone::ProcessedImageMsg& msg, cv_bridge::CvImagePtr& image,
+                const std::string& encoding = sensor_msgs::image_encodings::BGR8);
+};
+
+#endif /* ucl_drone_IMAGE_PAYLOAD_H */
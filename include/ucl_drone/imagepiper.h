@@ -9,6 +9,7 @@
 #include <std_msgs/Float32.h>
 
 #include <ucl_drone/profiling.h>
+#include <ucl_drone/image_payload.h>
 
 // Messages
 #include <std_msgs/Empty.h>
@@ -26,6 +27,7 @@ class Piper
 {
 private:
   ros::NodeHandle nh;
+  ImagePayload image_payload;  //!< gives the image of processed images, whatever their payload
   ros::Publisher im_pub;
   ros::Subscriber proc_im_sub;
   std::string proc_im_channel;
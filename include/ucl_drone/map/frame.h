@@ -33,7 +33,7 @@
 /* ucl_drone */
 #include <ucl_drone/Pose3D.h>
 #include <ucl_drone/ProcessedImageMsg.h>
-#include <ucl_drone/constants/feature_types.h>
+#include <ucl_drone/computer_vision/feature_types.h>
 
 // class MappingNode is defined in ucl_drone/map/simple_map.h
 // not declared here because ucl_drone/map/frame.h (current file)
@@ -56,9 +56,11 @@ public:
 
   // Attributes
   std::vector<cv::Point2f> img_points; //!< 2D coordinates of keypoints in image in OpenCV format
+  std::vector<uint32_t> track_ids;     //!< track of each keypoint (see ProcessedImageMsg), empty if unknown
   cv::Mat descriptors;                 //!< descriptors of keypoints in OpenCV format
   ucl_drone::Pose3D pose;            //!< pose from which frame was taken
-  sensor_msgs::Image image;            //!< video image in the ROS format after rescaling
+  int image_width;                     //!< width of the rescaled video image
+  int image_height;                    //!< height of the rescaled video image
 };
 
 #endif /* ucl_drone_FRAME_H */
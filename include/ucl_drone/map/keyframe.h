@@ -22,7 +22,7 @@
 #include <opencv2/nonfree/nonfree.hpp>
 
 /* ucl_drone */
-#include <ucl_drone/constants/feature_types.h>
+#include <ucl_drone/computer_vision/feature_types.h>
 
 #include <ucl_drone/Pose3D.h>
 #include <ucl_drone/opencv_utils.h>
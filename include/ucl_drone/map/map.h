@@ -21,6 +21,7 @@
 
 #include <set>
 #include <map> //std::map key-value pair
+#include <limits>
 
 // vision
 #include <opencv2/calib3d/calib3d.hpp>
@@ -73,6 +74,8 @@ class Map
 private:
   // Some static const parameters
   static const int threshold_lost = 10; //!< Drone is considered as lost when it has less RANSAC inliers than this
+  static const int ransac_iterations = 2500; //!< RANSAC iterations of PnP after matching with the whole map
+  static constexpr double max_dead_fraction = 0.2; //!< Landmark rows are compacted when more than this fraction is dead
 
   //Nodehandle and publisher to communicate with bundle adjuster
   ros::NodeHandle* nh;  //!< pointer to ROS node handle of MappingNode
@@ -82,8 +85,10 @@ private:
   ros::Publisher benchmark_pub;      //!< Publisher of benchamrk information
 
   //ROS parameters (can be set in lauch files)
-  double thresh_descriptor_match; //!< Threshold for matches between descriptors
+  double keyframe_match_factor;   //!< Threshold for matches between keyframe descriptors, times FeatureTypes::dist_threshold
   int    max_matches;             //!< Max number of matches when matching sets of descriptors
+  double match_ratio;             //!< Ratio test of descriptor matches: best distance below match_ratio times the second (0: none)
+  bool   cross_check;             //!< If true, descriptor matches must be mutual nearest neighbours (not with the map index)
   bool   no_bundle_adjustment;    //!< If true, bundle adjustment is never performed
   bool   only_init;               //!< If true, no keyframes are created after initialization
   double outlier_threshold; //!< Threshold on contribution to bundle adjustment objective for a point to be considered an outlier
@@ -91,6 +96,10 @@ private:
   bool   sonar_unavailable; //!< Set true for tests with the drone landed and sonar data is unavailable to use visual data instead
   int    n_kf_local_ba;     //!< Number of keyframes to adjust when running local bundle adjustment
   int    freq_global_ba;    //!< Frequency at which to run global bundle adjustment
+  bool   guided_matching;   //!< If true, landmarks are matched with the keypoints around their projection (prior pose)
+  double guided_radius;     //!< Search radius around the projection of a landmark (pixels)
+  int    guided_min_matches;       //!< Below this number of guided and tracked matches, the frame is matched with the whole map
+  int    guided_ransac_iterations; //!< RANSAC iterations of PnP after guided matching (fewer outliers)
 
   //ROS parameters (used for keyframe needed decision)
   double min_dist; //!< Minimal distance to last keyframe to create a new one
@@ -112,11 +121,54 @@ private:
   ucl_drone::Pose3D manual_pose; //!< Manual pose (received from user) if using it
   bool                manual_pose_available; //!< true when a manual pose is available
 
-  std::vector<int> landmark_IDs;     //!< Vector of IDs for each landmark in the map
-  std::map<int,Landmark*> landmarks; //!< Map of landmark IDs to landmarks
+  // Landmarks are stored in dense rows: row i of landmark_IDs, landmark_ptrs, landmark_valid, descriptors
+  // and cloud is the same landmark. A removed landmark leaves a dead row, skipped by the matchers, until
+  // the rows are compacted (when more than max_dead_fraction of them are dead).
+  // Rows do not move between two compactions.
+  std::vector<int> landmark_IDs;        //!< ID of the landmark in each row (-1 if dead)
+  std::vector<Landmark*> landmark_ptrs; //!< Landmark in each row (NULL if dead)
+  std::vector<char> landmark_valid;     //!< 1 for the rows of landmarks in the map, 0 for dead rows
+  int n_dead_rows;                      //!< Number of dead rows
+  std::vector<int> landmark_rows;       //!< Row of each landmark, indexed by landmark ID (-1 if not in the map)
   std::map<int,Keyframe*> keyframes; //!< Map of keyframe IDs to keyframes
   std::map<int,Keyframe*>::iterator first_kf_to_adjust; //!< Iterator to oldest keyframe to include in local bundle adjsutment
   cv::Mat descriptors; //!< descriptors of landmarks
+  std::map<uint32_t,int> track_landmarks; //!< landmark ID of each keypoint track that was a PnP inlier in the last frame
+  MapIndex descriptor_index; //!< persistent index of descriptors (used if descriptors are not matched by brute force)
+
+ /**
+  * Match descriptors with the live landmarks of the map (with descriptor_index, or by brute force)
+  * @param[in]  query         Descriptors to match
+  * @param[out] map_indices   Rows of the matching landmarks
+  * @param[out] query_indices Rows of the matching descriptors in query
+  */
+  void matchWithMap(const cv::Mat& query, std::vector<int>& map_indices, std::vector<int>& query_indices);
+
+ /**
+  * Match keypoints of a frame with the landmarks projected in the image at the prior pose of the frame
+  * @param[in]  frame           The frame (pose used as prior)
+  * @param[in]  keypoints       Indices of the keypoints to match in the frame
+  * @param[in]  keypoints_descriptors Descriptors of these keypoints
+  * @param[in]  landmark_used   Rows of the landmarks already associated (not matched again)
+  * @param[in]  n_associated    Number of keypoints of the frame already associated (by tracking)
+  * @param[out] map_indices     Rows of the matching landmarks
+  * @param[out] keypoint_indices Indices of the matching keypoints in keypoints
+  * @return false if there are less than guided_min_matches matches, with the n_associated ones
+  *         (the prior pose is likely wrong)
+  */
+  bool matchGuided(const Frame& frame, const std::vector<int>& keypoints, const cv::Mat& keypoints_descriptors,
+                   const std::vector<char>& landmark_used, int n_associated, std::vector<int>& map_indices,
+                   std::vector<int>& keypoint_indices);
+
+ /**
+  * Mark a row of the landmarks as dead (its point in cloud becomes NaN)
+  */
+  void killLandmarkRow(int idx);
+
+ /**
+  * Move the rows of the landmarks over the dead ones, in a single pass
+  */
+  void compactLandmarks();
 
  /**
   * This method computes the PnP estimation
@@ -131,7 +183,9 @@ private:
   cv::Mat rvec;  //!< last rotational vector (PnP estimation)
 
  /**
-  * Match a frame with the map
+  * Match a frame with the map.
+  * Keypoints whose track was associated with a landmark in the last frame keep this landmark,
+  * only the other ones are matched with the descriptors of the map.
   * @param[in]  frame                         The frame to match
   * @param[out] inliers_map_matching_points   The 3D points from the map with a match in the frame
   * @param[out] inliers_frame_matching_points The 2D points from the frame with a match in the map
@@ -182,16 +236,6 @@ private:
   void doBundleAdjustment(std::vector<int> kfIDs, bool is_global);
   void targetDetectedPublisher();
 
- /**
-  * Add a landmark to the map
-  */
-  int addPoint(cv::Point3d& coordinates, cv::Mat& descriptor);
-
- /**
-  * Remove a landmark from the map
-  */
-  void removePoint(int ptID);
-
  /**
   * Update the coordinates of a landmark
   * @param[in] ptID ID of point to update
@@ -225,6 +269,39 @@ public:
 
   void reset();
 
+ /**
+  * Add a landmark to the map
+  * @return the ID of the new landmark
+  */
+  int addPoint(cv::Point3d& coordinates, cv::Mat& descriptor);
+
+ /**
+  * Remove a landmark from the map (its row becomes dead)
+  */
+  void removePoint(int ptID);
+
+ /**
+  * @return the row of landmark ptID in the landmark rows, descriptors and cloud (-1 if it does not exist)
+  */
+  int landmarkIndex(int ptID) const;
+
+ /**
+  * @return the number of landmarks in the map (dead rows excluded)
+  */
+  int landmarkCount() const;
+
+ /**
+  * @return the landmark ptID (NULL if it does not exist)
+  */
+  Landmark* landmark(int ptID) const;
+
+  // Inspection of the landmark rows (row i of landmarkDescriptors() and cloud is the same landmark)
+  int landmarkRows() const;              //!< Number of landmark rows, dead ones included
+  int deadLandmarkRows() const;          //!< Number of dead rows
+  bool landmarkRowValid(int row) const;  //!< false if row is dead
+  int landmarkRowID(int row) const;      //!< ID of the landmark in row (-1 if dead)
+  const cv::Mat& landmarkDescriptors() const; //!< Descriptors of the landmarks, one per row
+
  /**
   * This function is called on each new frame, it calls pnp, and the decision to create a keyframe.
   * @param[in] frame Frame to process (estimate position, and decide whether to craete a keyframe)
@@ -0,0 +1,108 @@
+/*!
+ *  \file map_index.h
+ *  \brief This header file contains the persistent descriptor index of the map
+ *  \authors Boris Dehem
+ *  \year 2017
+ *
+ *  The live rows of the map descriptors, up to a given row, are indexed by a FLANN snapshot; the
+ *  rows added since the snapshot was built are searched by brute force. Dead rows (see
+ *  Map::landmark_valid) are skipped in the results. When the live rows added since the snapshot
+ *  (or the dead rows in it) are too many, a new snapshot is built on a background thread and
+ *  replaces the old one when it is ready. When the rows of the map move (compaction), the rows of
+ *  the snapshot are remapped: the snapshot is kept.
+ */
+
+#ifndef ucl_drone_MAPINDEX_H
+#define ucl_drone_MAPINDEX_H
+
+#include <ros/ros.h>
+
+#include <opencv2/core/core.hpp>
+#include <opencv2/features2d/features2d.hpp>
+#include <opencv2/flann/flann.hpp>
+
+#include <boost/thread/mutex.hpp>
+#include <boost/thread/thread.hpp>
+
+/**
+ * \class MapIndex
+ * Long-lived nearest neighbour index over the rows of the map descriptors
+ */
+class MapIndex
+{
+private:
+  static const int min_snapshot_rows = 500;          //!< rows are searched by brute force until the map has this many
+  static constexpr double rebuild_fraction = 0.25;   //!< snapshot rebuilt when the live rows added since, or its dead
+                                                     //!< rows, exceed this fraction of its rows
+  static const int snapshot_neighbours = 4;          //!< min neighbours searched in the snapshot (some may be dead)
+
+  cv::Ptr<cv::flann::Index> index; //!< snapshot (NULL if none)
+  cv::Mat indexed;                 //!< descriptors indexed by the snapshot (must outlive it)
+  std::vector<int> snapshot_map;   //!< map row of each row of the snapshot (-1 if removed by a compaction)
+  int snapshot_dead;               //!< number of rows of the snapshot removed by compactions
+  int delta_start;                 //!< first map row added since the snapshot (rows before are all in it)
+  int version;                     //!< incremented when the map is reset, older snapshots are discarded
+
+  // Background build
+  boost::thread builder;                    //!< thread building the next snapshot
+  boost::mutex build_mutex;                 //!< protects the attributes below
+  bool building;                            //!< true while builder runs
+  cv::Ptr<cv::flann::Index> built_index;    //!< snapshot built, not swapped in yet
+  cv::Mat built_indexed;                    //!< descriptors indexed by built_index
+  int built_version;                        //!< version of the map when built_index was started
+  // remapped by compactions while the snapshot is built (only used by the main thread)
+  std::vector<int> build_map;               //!< map row of each row of the snapshot being built
+  int build_delta_start;                    //!< first map row not in the snapshot being built
+
+  //! Swap in the snapshot built in background, and start a new build if needed
+  void update(const cv::Mat& descriptors, const std::vector<char>& valid);
+
+  //! Build a snapshot of indexed (thread)
+  void build(cv::Mat indexed, int version);
+
+  //! Nearest live rows of each query descriptor in the snapshot (up to k, more are searched if some are dead)
+  void searchSnapshot(const std::vector<char>& valid, const cv::Mat& query,
+                      std::vector<std::vector<cv::DMatch> >& matches, int k);
+
+public:
+  //! Constructor (empty index)
+  MapIndex();
+
+  //! Copy constructor: the snapshot is not copied, the copy starts empty
+  MapIndex(const MapIndex& other);
+
+  //! Assignment: waits for the build in progress and forgets the snapshot (the index starts empty)
+  MapIndex& operator=(const MapIndex& other);
+
+  //! Destructor (waits for the build in progress)
+  ~MapIndex();
+
+  //! Forget the snapshot (the map is empty)
+  void reset();
+
+  //! Wait for the snapshot being built in background, if any (it is swapped in by the next knnMatch)
+  void waitForBuild();
+
+  //! @return true if rows of the map are searched in a snapshot
+  bool hasSnapshot() const;
+
+ /**
+  * The rows of the map moved (compaction, the order of the rows is kept): the snapshot is remapped
+  * @param[in] new_rows New row of each old row of the map (-1 if removed)
+  */
+  void rowsMoved(const std::vector<int>& new_rows);
+
+ /**
+  * Find the k nearest live map rows of each query descriptor
+  * @param[in]  descriptors Descriptors of the map (one per row)
+  * @param[in]  valid       valid[i] == 0 if row i of descriptors is dead
+  * @param[in]  query       Query descriptors
+  * @param[out] matches     For each query row, the k nearest live rows sorted by distance (less if the map
+  *                         has less live rows) (queryIdx = query row, trainIdx = map row)
+  * @param[in]  k           Number of neighbours
+  */
+  void knnMatch(const cv::Mat& descriptors, const std::vector<char>& valid, const cv::Mat& query,
+                std::vector<std::vector<cv::DMatch> >& matches, int k);
+};
+
+#endif /*ucl_drone_MAPINDEX_H*/
@@ -20,21 +20,42 @@
 #include <opencv2/nonfree/nonfree.hpp>
 #include <boost/shared_ptr.hpp>
 
+#include <ucl_drone/computer_vision/matching_engine.h>
 #include <ucl_drone/map/camera.h>
 #include <ucl_drone/map/keyframe.h>
+#include <ucl_drone/map/map_index.h>
 
 
 /**
  * Obtain matches between two sets of descriptors
+ * (each descriptor of both sets is matched at most once)
  * @param[in]  descriptors1       First set of descriptors
  * @param[in]  descriptors2       Second set of descriptors
  * @param[out] matching_indices_1 Indices of matches in the first set
  * @param[out] matching_indices_2 Indices of matches in the second set
- * @param[in]  threshold          Distance threshold for a pair to be considered a match
- * @param[in]  max_matches        Maximal number of matches allowed (no limit if maxmatches is negative)
+ * @param[in]  options            Selection of the matches (threshold, ratio test, cross-check, max number)
+ * @param[in]  valid1             Rows of descriptors1 to match (valid1[i] == 0: row i is ignored), all if NULL
+ * @param[in]  valid2             Rows of descriptors2 to match (valid2[i] == 0: row i is ignored), all if NULL
  */
 void matchDescriptors(const cv::Mat& descriptors1, const cv::Mat& descriptors2,
-  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, double threshold, int max_matches);
+  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, const MatchOptions& options,
+  const std::vector<char>* valid1 = NULL, const std::vector<char>* valid2 = NULL);
+
+/**
+ * Obtain matches between the map and a set of descriptors, with the persistent index of the map
+ * (each map row and each descriptor is matched at most once)
+ * @param[in]  index              Index of the map descriptors
+ * @param[in]  map_descriptors    Descriptors of the map
+ * @param[in]  valid              valid[i] == 0 if row i of map_descriptors is dead
+ * @param[in]  descriptors2       Descriptors to match with the map
+ * @param[out] matching_indices_1 Indices of matches in the map
+ * @param[out] matching_indices_2 Indices of matches in descriptors2
+ * @param[in]  options            Selection of the matches (no cross-check: the map is not searched from the
+ *                                map rows, only from descriptors2)
+ */
+void matchDescriptors(MapIndex& index, const cv::Mat& map_descriptors, const std::vector<char>& valid,
+  const cv::Mat& descriptors2, std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2,
+  const MatchOptions& options);
 
 /**
  * Obtain matches between two sets of descriptors
@@ -47,12 +68,38 @@ void matchDescriptors(const cv::Mat& descriptors1, const cv::Mat& descriptors2,
  * @param[in]  ptIDs2             Point IDs of first set in the second keyframe (negative for unmatched points)
  * @param[out] matching_indices_1 Indices of matches in the first set
  * @param[out] matching_indices_2 Indices of matches in the second set
- * @param[in]  threshold          Distance threshold for a pair to be considered a match
- * @param[in]  max_matches        Maximal number of matches allowed (no limit if maxmatches is negative)
+ * @param[in]  options            Selection of the matches (threshold, ratio test, cross-check, max number)
  */
 void matchDescriptors(const cv::Mat& descriptors1, const cv::Mat& descriptors2,
   const std::vector<int>& ptIDs1, const std::vector<int>& ptIDs2,
-  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, double threshold, int max_matches);
+  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, const MatchOptions& options);
+
+/**
+ * Obtain matches between projected landmarks and keypoints: each landmark is only compared with
+ * the keypoints within radius pixels of its projection (found in a grid of radius x radius cells)
+ * (each landmark and each keypoint is matched at most once)
+ * @param[in]  projections        Projections of the landmarks in the image
+ * @param[in]  rows               Row of each projected landmark in map_descriptors
+ * @param[in]  map_descriptors    Descriptors of the map
+ * @param[in]  points             Keypoints in the image
+ * @param[in]  descriptors2       Descriptors of the keypoints
+ * @param[in]  radius             Search radius around the projections (pixels)
+ * @param[in]  threshold          Distance threshold for a pair to be considered a match
+ * @param[out] matching_indices_1 Rows of matches in map_descriptors
+ * @param[out] matching_indices_2 Indices of matches in points
+ */
+void matchProjections(const std::vector<cv::Point2f>& projections, const std::vector<int>& rows,
+  const cv::Mat& map_descriptors, const std::vector<cv::Point2f>& points, const cv::Mat& descriptors2,
+  double radius, double threshold, std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2);
+
+/**
+ * Distance between two descriptors, as computed by the matchers (L2, or Hamming for binary descriptors)
+ * @param[in] descriptors1 First set of descriptors
+ * @param[in] i1           Row of the first descriptor in descriptors1
+ * @param[in] descriptors2 Second set of descriptors (same type as descriptors1)
+ * @param[in] i2           Row of the second descriptor in descriptors2
+ */
+float descriptorDistance(const cv::Mat& descriptors1, int i1, const cv::Mat& descriptors2, int i2);
 
 /**
  * Obtain Distance between two poses (disregarding rotations)
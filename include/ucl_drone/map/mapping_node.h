@@ -52,6 +52,7 @@
 #include <ucl_drone/StrategyMsg.h>
 #include <ucl_drone/BundleMsg.h>
 #include <ucl_drone/TargetDetected.h>
+#include <ucl_drone/TargetsMsg.h>
 #include <ucl_drone/map/projection_2D.h>
 #include <ucl_drone/opencv_utils.h>
 #include <ucl_drone/read_from_launch.h>
@@ -74,6 +75,8 @@ private:
   ros::Subscriber strategy_sub;            //!< Subscriber to strategy messages
   std::string     processed_image_channel; //!< Channel for processed images
   ros::Subscriber processed_image_sub;     //!< Subscriber to processed images
+  std::string     targets_channel;         //!< Channel for targets searched apart from processed images
+  ros::Subscriber targets_sub;             //!< Subscriber to targets searched apart from processed images
   std::string     bundled_channel;         //!< Channel for the result of bundle adjustment
   ros::Subscriber bundled_sub;             //!< Subscriber to the result of bundle adjustment
   std::string     mpe_channel;             //!< Channel for manual pose estimation
@@ -92,7 +95,8 @@ private:
   std::string    target_channel;          //!< Channel for target
   ros::Publisher target_pub;              //!< Publisher of target
 
-  ucl_drone::ProcessedImageMsg::ConstPtr lastProcessedImgReceived;  //!< last ProcessedImage message received
+  ucl_drone::Pose3D target_pose;   //!< pose of the image in which the target was last detected
+  cv::Point2f       target_center; //!< center of the target in this image
 
   /* Attributes */
   int  strategy;        //!< current strategy
@@ -105,6 +109,7 @@ private:
    * Called at every image frame.
    */
   void processedImageCb(const ucl_drone::ProcessedImageMsg::ConstPtr processed_image_in);
+  void targetsCb(const ucl_drone::TargetsMsg::ConstPtr targets_in); //!< Callback for targets searched asynchronously
   void resetPoseCb(const std_msgs::Empty& msg); //!< Callback for when a pose reset message is received
   void endResetPoseCb(const std_msgs::Empty& msg); //!< Callback for when an end pose reset message is received
   void strategyCb(const ucl_drone::StrategyMsg::ConstPtr strategyPtr); //!< Callback for when a strategy message is received
@@ -14,10 +14,12 @@
 #include <ros/ros.h>
 
 #include <ucl_drone/profiling.h>
+#include <ucl_drone/image_payload.h>
 
 // messages
 #include <sensor_msgs/image_encodings.h>
 #include <ucl_drone/ProcessedImageMsg.h>
+#include <ucl_drone/TargetsMsg.h>
 
 // vision
 #include <cv_bridge/cv_bridge.h>
@@ -49,12 +51,19 @@ private:
   //! Subscribers
   ros::Subscriber processed_img_sub;
   std::string processed_img_channel;
+  ros::Subscriber targets_sub;
+  std::string targets_channel;
+  ImagePayload image_payload; //!< gives the image of processed images, whatever their payload
 
   //! Callbacks
   void processedImageCb(const ucl_drone::ProcessedImageMsg::ConstPtr processed_image);
+  void targetsCb(const ucl_drone::TargetsMsg::ConstPtr targets); //!< targets searched asynchronously
 
-  //! Translation to OpenCV format
-  void convertMsgToAttributes(ucl_drone::ProcessedImageMsg::ConstPtr msg);
+  //! Store the corners and center of the first target detected
+  void setTarget(bool detected, const std::vector< geometry_msgs::Point >& target_points);
+
+  //! Translation to OpenCV format. \return false if the image is not available
+  bool convertMsgToAttributes(ucl_drone::ProcessedImageMsg::ConstPtr msg);
 
   //! Measure
   ucl_drone::ProcessedImageMsg::ConstPtr lastProcessedImgReceived;
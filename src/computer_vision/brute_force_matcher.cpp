@@ -0,0 +1,137 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/brute_force_matcher.h>
+
+/** \class KnnSearch
+ *  Brute force search of a range of query rows (one iteration of cv::parallel_for_)
+ */
+class KnnSearch : public cv::ParallelLoopBody
+{
+private:
+  const cv::Mat& query;
+  const cv::Mat& train;
+  std::vector< std::vector< cv::DMatch > >& matches;
+  int k;
+  int norm;
+  const std::vector< char >* query_valid;
+  const std::vector< char >* train_valid;
+
+public:
+  KnnSearch(const cv::Mat& query, const cv::Mat& train, std::vector< std::vector< cv::DMatch > >& matches,
+            int k, int norm, const std::vector< char >* query_valid, const std::vector< char >* train_valid)
+    : query(query), train(train), matches(matches), k(k), norm(norm), query_valid(query_valid),
+      train_valid(train_valid)
+  {
+  }
+
+  //! \return the distance between query row i and train row j (squared for L2)
+  float distance(int i, int j) const
+  {
+    if (query.depth() == CV_32F)
+      return DescriptorDistance::l2sqr(query.ptr< float >(i), train.ptr< float >(j), query.cols);
+    if (norm == cv::NORM_HAMMING)
+      return DescriptorDistance::hamming(query.ptr< uint8_t >(i), train.ptr< uint8_t >(j), query.cols);
+    return DescriptorDistance::l2sqr(query.ptr< uint8_t >(i), train.ptr< uint8_t >(j), query.cols);
+  }
+
+  void operator()(const cv::Range& range) const
+  {
+    bool squared = norm != cv::NORM_HAMMING;
+    for (int i = range.start; i < range.end; i++)
+    {
+      // best[0..n-1]: nearest train rows found so far, sorted by distance
+      std::vector< cv::DMatch >& best = matches[i];
+      best.clear();
+      if (query_valid && !(*query_valid)[i])
+        continue;
+      best.reserve(k + 1);
+      for (int j = 0; j < train.rows; j++)
+      {
+        if (train_valid && !(*train_valid)[j])
+          continue;
+        float d = distance(i, j);
+        if ((int)best.size() == k && d >= best.back().distance)
+          continue;
+        // insertion in the sorted list of the k best
+        int pos = best.size();
+        best.push_back(cv::DMatch());
+        while (pos > 0 && best[pos - 1].distance > d)
+        {
+          best[pos] = best[pos - 1];
+          pos--;
+        }
+        best[pos] = cv::DMatch(i, j, d);
+        if ((int)best.size() > k)
+          best.pop_back();
+      }
+      if (squared)
+      {
+        for (unsigned n = 0; n < best.size(); n++)
+          best[n].distance = std::sqrt(best[n].distance);
+      }
+    }
+  }
+};
+
+void bruteForceKnnMatch(const cv::Mat& query, const cv::Mat& train,
+                        std::vector< std::vector< cv::DMatch > >& matches, int k, int norm,
+                        const std::vector< char >* query_valid, const std::vector< char >* train_valid)
+{
+  matches.clear();
+  matches.resize(query.rows);
+  if (query.rows == 0 || train.rows == 0)
+    return;
+  CV_Assert(query.type() == train.type() && query.cols == train.cols);
+  CV_Assert(query.type() == CV_8U || (query.type() == CV_32F && norm == cv::NORM_L2));
+  cv::parallel_for_(cv::Range(0, query.rows),
+                    KnnSearch(query, train, matches, k, norm, query_valid, train_valid));
+}
+
+void bruteForceMatch(const cv::Mat& query, const cv::Mat& train, std::vector< cv::DMatch >& matches,
+                     int norm)
+{
+  std::vector< std::vector< cv::DMatch > > knn_matches;
+  bruteForceKnnMatch(query, train, knn_matches, 1, norm);
+  matches.clear();
+  matches.reserve(knn_matches.size());
+  for (unsigned i = 0; i < knn_matches.size(); i++)
+  {
+    if (!knn_matches[i].empty())
+      matches.push_back(knn_matches[i][0]);
+  }
+}
+
+void flannKnnMatch(cv::flann::Index& index, const cv::Mat& query,
+                   std::vector< std::vector< cv::DMatch > >& matches, int k, int norm)
+{
+  matches.clear();
+  matches.resize(query.rows);
+  if (query.rows == 0)
+    return;
+  bool squared = norm != cv::NORM_HAMMING;  // FLANN gives squared L2 distances
+  cv::Mat float_query;
+  if (squared && query.depth() != CV_32F)  // FLANN KD-trees only index float rows
+    query.convertTo(float_query, CV_32F);
+  cv::Mat indices, dists;
+  index.knnSearch(float_query.empty() ? query : float_query, indices, dists, k, cv::flann::SearchParams(32));
+  dists.convertTo(dists, CV_32F);  // integer distances for binary descriptors
+  for (int i = 0; i < query.rows; i++)
+  {
+    for (int n = 0; n < k; n++)
+    {
+      int j = indices.at< int >(i, n);
+      if (j < 0)  // LSH may find less than k neighbours
+        break;
+      float d = dists.at< float >(i, n);
+      matches[i].push_back(cv::DMatch(i, j, squared ? std::sqrt(d) : d));
+    }
+  }
+}
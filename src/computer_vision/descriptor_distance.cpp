@@ -0,0 +1,224 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/descriptor_distance.h>
+
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+/* Generic kernels */
+
+float l2sqrGeneric(const float* a, const float* b, int n)
+{
+  float d0 = 0, d1 = 0, d2 = 0, d3 = 0;
+  int i = 0;
+  for (; i + 4 <= n; i += 4)
+  {
+    float t0 = a[i] - b[i], t1 = a[i + 1] - b[i + 1];
+    float t2 = a[i + 2] - b[i + 2], t3 = a[i + 3] - b[i + 3];
+    d0 += t0 * t0;
+    d1 += t1 * t1;
+    d2 += t2 * t2;
+    d3 += t3 * t3;
+  }
+  for (; i < n; i++)
+  {
+    float t = a[i] - b[i];
+    d0 += t * t;
+  }
+  return d0 + d1 + d2 + d3;
+}
+
+int l2sqrU8Generic(const uint8_t* a, const uint8_t* b, int n)
+{
+  int d = 0;
+  for (int i = 0; i < n; i++)
+  {
+    int t = (int)a[i] - (int)b[i];
+    d += t * t;
+  }
+  return d;
+}
+
+int hammingGeneric(const uint8_t* a, const uint8_t* b, int n)
+{
+  int d = 0;
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    d += __builtin_popcountll(x ^ y);
+  }
+  for (; i < n; i++)
+    d += __builtin_popcount(a[i] ^ b[i]);
+  return d;
+}
+
+/* SSE2 kernels (always available on x86-64) */
+
+#if defined(__SSE2__)
+float l2sqrSSE2(const float* a, const float* b, int n)
+{
+  __m128 s0 = _mm_setzero_ps(), s1 = _mm_setzero_ps();
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    __m128 t0 = _mm_sub_ps(_mm_loadu_ps(a + i), _mm_loadu_ps(b + i));
+    __m128 t1 = _mm_sub_ps(_mm_loadu_ps(a + i + 4), _mm_loadu_ps(b + i + 4));
+    s0 = _mm_add_ps(s0, _mm_mul_ps(t0, t0));
+    s1 = _mm_add_ps(s1, _mm_mul_ps(t1, t1));
+  }
+  float s[4];
+  _mm_storeu_ps(s, _mm_add_ps(s0, s1));
+  float d = s[0] + s[1] + s[2] + s[3];
+  for (; i < n; i++)
+  {
+    float t = a[i] - b[i];
+    d += t * t;
+  }
+  return d;
+}
+
+int l2sqrU8SSE2(const uint8_t* a, const uint8_t* b, int n)
+{
+  // widen to 16 bits, then _mm_madd_epi16 sums the squares of pairs in 32 bits
+  const __m128i zero = _mm_setzero_si128();
+  __m128i s = _mm_setzero_si128();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m128i x = _mm_loadu_si128((const __m128i*)(a + i));
+    __m128i y = _mm_loadu_si128((const __m128i*)(b + i));
+    __m128i lo = _mm_sub_epi16(_mm_unpacklo_epi8(x, zero), _mm_unpacklo_epi8(y, zero));
+    __m128i hi = _mm_sub_epi16(_mm_unpackhi_epi8(x, zero), _mm_unpackhi_epi8(y, zero));
+    s = _mm_add_epi32(s, _mm_add_epi32(_mm_madd_epi16(lo, lo), _mm_madd_epi16(hi, hi)));
+  }
+  int32_t t[4];
+  _mm_storeu_si128((__m128i*)t, s);
+  int d = t[0] + t[1] + t[2] + t[3];
+  if (i < n)
+    d += l2sqrU8Generic(a + i, b + i, n - i);
+  return d;
+}
+#endif
+
+/* NEON kernels */
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+float l2sqrNEON(const float* a, const float* b, int n)
+{
+  float32x4_t s0 = vdupq_n_f32(0), s1 = vdupq_n_f32(0);
+  int i = 0;
+  for (; i + 8 <= n; i += 8)
+  {
+    float32x4_t t0 = vsubq_f32(vld1q_f32(a + i), vld1q_f32(b + i));
+    float32x4_t t1 = vsubq_f32(vld1q_f32(a + i + 4), vld1q_f32(b + i + 4));
+    s0 = vmlaq_f32(s0, t0, t0);
+    s1 = vmlaq_f32(s1, t1, t1);
+  }
+  float s[4];
+  vst1q_f32(s, vaddq_f32(s0, s1));
+  float d = s[0] + s[1] + s[2] + s[3];
+  for (; i < n; i++)
+  {
+    float t = a[i] - b[i];
+    d += t * t;
+  }
+  return d;
+}
+
+int l2sqrU8NEON(const uint8_t* a, const uint8_t* b, int n)
+{
+  uint32x4_t acc = vdupq_n_u32(0);
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    uint8x16_t t = vabdq_u8(vld1q_u8(a + i), vld1q_u8(b + i));
+    uint16x8_t lo = vmull_u8(vget_low_u8(t), vget_low_u8(t));
+    uint16x8_t hi = vmull_u8(vget_high_u8(t), vget_high_u8(t));
+    acc = vpadalq_u16(acc, lo);
+    acc = vpadalq_u16(acc, hi);
+  }
+  uint32_t s[4];
+  vst1q_u32(s, acc);
+  int d = s[0] + s[1] + s[2] + s[3];
+  if (i < n)
+    d += l2sqrU8Generic(a + i, b + i, n - i);
+  return d;
+}
+
+int hammingNEON(const uint8_t* a, const uint8_t* b, int n)
+{
+  uint32x4_t acc = vdupq_n_u32(0);
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    uint8x16_t bits = vcntq_u8(veorq_u8(vld1q_u8(a + i), vld1q_u8(b + i)));
+    acc = vpadalq_u16(acc, vpaddlq_u8(bits));
+  }
+  uint32_t s[4];
+  vst1q_u32(s, acc);
+  int d = s[0] + s[1] + s[2] + s[3];
+  if (i < n)
+    d += hammingGeneric(a + i, b + i, n - i);
+  return d;
+}
+#endif
+
+/* Dispatch */
+
+#if defined(UCL_DRONE_AVX2_KERNELS)
+static bool cpuHasAVX2()
+{
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma")
+         && __builtin_cpu_supports("popcnt");
+}
+#endif
+
+DescriptorDistance::Kernels DescriptorDistance::chooseKernels()
+{
+  Kernels k = { l2sqrGeneric, l2sqrU8Generic, hammingGeneric, "generic" };
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+  k.l2sqr    = l2sqrNEON;
+  k.l2sqr_u8 = l2sqrU8NEON;
+  k.hamming  = hammingNEON;
+  k.name     = "NEON";
+#endif
+#if defined(__SSE2__)
+  k.l2sqr    = l2sqrSSE2;
+  k.l2sqr_u8 = l2sqrU8SSE2;
+  k.name     = "SSE2";
+#endif
+#if defined(UCL_DRONE_AVX2_KERNELS)
+  if (cpuHasAVX2())
+  {
+    k.l2sqr    = l2sqrAVX2;
+    k.l2sqr_u8 = l2sqrU8AVX2;
+    k.hamming  = hammingAVX2;
+    k.name     = "AVX2";
+  }
+#endif
+  return k;
+}
+
+const DescriptorDistance::Kernels& DescriptorDistance::kernels()
+{
+  static const Kernels k = chooseKernels();  // thread-safe initialization (C++11)
+  return k;
+}
@@ -0,0 +1,103 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file (descriptor_distance.h).
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  This file is compiled with -mavx2 -mfma -mpopcnt: its functions must only be called
+ *  after checking that the CPU supports these instructions (see DescriptorDistance).
+ */
+
+#include <ucl_drone/computer_vision/descriptor_distance.h>
+
+#if defined(UCL_DRONE_AVX2_KERNELS)
+
+#include <immintrin.h>
+#include <string.h>
+
+float l2sqrAVX2(const float* a, const float* b, int n)
+{
+  __m256 s0 = _mm256_setzero_ps(), s1 = _mm256_setzero_ps();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m256 t0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    __m256 t1 = _mm256_sub_ps(_mm256_loadu_ps(a + i + 8), _mm256_loadu_ps(b + i + 8));
+    s0 = _mm256_fmadd_ps(t0, t0, s0);
+    s1 = _mm256_fmadd_ps(t1, t1, s1);
+  }
+  for (; i + 8 <= n; i += 8)
+  {
+    __m256 t0 = _mm256_sub_ps(_mm256_loadu_ps(a + i), _mm256_loadu_ps(b + i));
+    s0 = _mm256_fmadd_ps(t0, t0, s0);
+  }
+  __m256 s = _mm256_add_ps(s0, s1);
+  __m128 h = _mm_add_ps(_mm256_castps256_ps128(s), _mm256_extractf128_ps(s, 1));
+  h = _mm_add_ps(h, _mm_movehl_ps(h, h));
+  h = _mm_add_ss(h, _mm_shuffle_ps(h, h, 1));
+  float d = _mm_cvtss_f32(h);
+  for (; i < n; i++)
+  {
+    float t = a[i] - b[i];
+    d += t * t;
+  }
+  return d;
+}
+
+int l2sqrU8AVX2(const uint8_t* a, const uint8_t* b, int n)
+{
+  // widen to 16 bits, then _mm256_madd_epi16 sums the squares of pairs in 32 bits
+  __m256i s = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 16 <= n; i += 16)
+  {
+    __m256i x = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(a + i)));
+    __m256i y = _mm256_cvtepu8_epi16(_mm_loadu_si128((const __m128i*)(b + i)));
+    __m256i t = _mm256_sub_epi16(x, y);
+    s = _mm256_add_epi32(s, _mm256_madd_epi16(t, t));
+  }
+  __m128i h = _mm_add_epi32(_mm256_castsi256_si128(s), _mm256_extracti128_si256(s, 1));
+  h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(1, 0, 3, 2)));
+  h = _mm_add_epi32(h, _mm_shuffle_epi32(h, _MM_SHUFFLE(2, 3, 0, 1)));
+  int d = _mm_cvtsi128_si32(h);
+  for (; i < n; i++)
+  {
+    int t = (int)a[i] - (int)b[i];
+    d += t * t;
+  }
+  return d;
+}
+
+int hammingAVX2(const uint8_t* a, const uint8_t* b, int n)
+{
+  // popcount of each byte with a nibble lookup table, summed with _mm256_sad_epu8
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4,
+                                       0, 1, 1, 2, 1, 2, 2, 3, 1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low_mask = _mm256_set1_epi8(0x0f);
+  __m256i acc = _mm256_setzero_si256();
+  int i = 0;
+  for (; i + 32 <= n; i += 32)
+  {
+    __m256i x = _mm256_xor_si256(_mm256_loadu_si256((const __m256i*)(a + i)),
+                                 _mm256_loadu_si256((const __m256i*)(b + i)));
+    __m256i lo = _mm256_shuffle_epi8(lut, _mm256_and_si256(x, low_mask));
+    __m256i hi = _mm256_shuffle_epi8(lut, _mm256_and_si256(_mm256_srli_epi16(x, 4), low_mask));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(_mm256_add_epi8(lo, hi), _mm256_setzero_si256()));
+  }
+  int d = _mm256_extract_epi64(acc, 0) + _mm256_extract_epi64(acc, 1) + _mm256_extract_epi64(acc, 2)
+          + _mm256_extract_epi64(acc, 3);
+  for (; i + 8 <= n; i += 8)
+  {
+    uint64_t x, y;
+    memcpy(&x, a + i, 8);
+    memcpy(&y, b + i, 8);
+    d += _mm_popcnt_u64(x ^ y);
+  }
+  for (; i < n; i++)
+    d += _mm_popcnt_u32(a[i] ^ b[i]);
+  return d;
+}
+
+#endif /* UCL_DRONE_AVX2_KERNELS */
@@ -0,0 +1,434 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere & Boris Dehem
+ *  \date 2016-2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/feature_types.h>
+
+#include <algorithm>
+
+std::string FeatureTypes::_detector_name;
+cv::Ptr< cv::FeatureDetector > FeatureTypes::_detector;
+cv::Ptr< cv::DescriptorExtractor > FeatureTypes::_extractor;
+cv::Ptr< cv::Feature2D > FeatureTypes::_features;
+DescriptorInfo FeatureTypes::_descriptor;
+bool FeatureTypes::_brute_force = true;
+bool FeatureTypes::_quantize    = true;
+bool FeatureTypes::_fused       = true;
+
+//! Default pipeline (used when nothing is specified in the launch file)
+static const std::string DEFAULT_DETECTOR  = "SURF";
+static const std::string DEFAULT_EXTRACTOR = "SIFT";
+
+/* Detectors */
+
+static cv::FeatureDetector *newSiftDetector()
+{
+  // return new cv::SIFT(0, 3, 0.1, 20, 3);
+  return new cv::SIFT(0, 3, 0.1, 15, 2);
+}
+
+static cv::FeatureDetector *newSurfDetector()
+{
+  // return new cv::SurfFeatureDetector(8000, 8, 3);
+  // return new cv::SurfFeatureDetector(4000, 6, 4, false);
+  // return new cv::SurfFeatureDetector(2000, 8, 3, false);
+  return new cv::SurfFeatureDetector(1800, 6, 3, false);
+}
+
+static cv::FeatureDetector *newFastDetector() { return new cv::FastFeatureDetector(50); }
+static cv::FeatureDetector *newStarDetector() { return new cv::StarFeatureDetector(); }
+static cv::FeatureDetector *newBriskDetector() { return new cv::BRISK(); }
+
+static cv::FeatureDetector *newOrbDetector()
+{
+  return new cv::OrbFeatureDetector(200, 1.4f, 5, 60, 2, 2, cv::ORB::HARRIS_SCORE, 60);
+}
+
+/** \struct DetectorEntry
+ *  Entry of the detector registry
+ */
+struct DetectorEntry
+{
+  const char *name;
+  cv::FeatureDetector *(*create)();
+};
+
+static const DetectorEntry DETECTORS[] = {
+  { "SIFT", newSiftDetector },   { "SURF", newSurfDetector },   { "FAST", newFastDetector },
+  { "STAR", newStarDetector },   { "BRISK", newBriskDetector }, { "ORB", newOrbDetector },
+};
+
+/* Extractors */
+
+static cv::DescriptorExtractor *newSiftExtractor() { return new cv::SiftDescriptorExtractor(); }
+
+static cv::DescriptorExtractor *newSurfExtractor()
+{
+  // return new cv::SurfDescriptorExtractor(4000, 6, 4, false);
+  return new cv::SurfDescriptorExtractor(15000, 6, 4, false);
+}
+
+static cv::DescriptorExtractor *newSurf128Extractor()
+{
+  return new cv::SurfDescriptorExtractor(4000, 6, 4, true);
+}
+
+static cv::DescriptorExtractor *newBriskExtractor() { return new cv::BRISK(); }
+static cv::DescriptorExtractor *newOrbExtractor() { return new cv::OrbDescriptorExtractor(); }
+static cv::DescriptorExtractor *newFreakExtractor() { return new cv::FREAK(); }
+
+/** \struct ExtractorEntry
+ *  Entry of the extractor registry
+ */
+struct ExtractorEntry
+{
+  const char *name;
+  cv::DescriptorExtractor *(*create)();
+  int size;              //!< descriptor length (number of elements)
+  int type;              //!< descriptor element type
+  int norm;              //!< distance metric
+  double dist_threshold; //!< Max distance s.t. two features descriptions are similar
+  double quantization;   //!< scale to store float descriptors as uint8 (0: cannot be quantized)
+};
+
+// OpenCV SIFT descriptors are float values of integers in [0, 255]: they are quantized
+// without loss (scale 1, same threshold)
+static const ExtractorEntry EXTRACTORS[] = {
+  { "SIFT", newSiftExtractor, 128, CV_32F, cv::NORM_L2, 200.0, 1.0 },  // (250)
+  { "SURF", newSurfExtractor, 64, CV_32F, cv::NORM_L2, 0.25, 0.0 },
+  { "SURF_128", newSurf128Extractor, 128, CV_32F, cv::NORM_L2, 0.25, 0.0 },
+  { "BRISK", newBriskExtractor, 64, CV_8U, cv::NORM_HAMMING, 200.0, 0.0 },
+  { "ORB", newOrbExtractor, 32, CV_8U, cv::NORM_HAMMING, 50.0, 0.0 },
+  { "FREAK", newFreakExtractor, 64, CV_8U, cv::NORM_HAMMING, 200.0, 0.0 },
+};
+
+/* Fused detectors and extractors: same parameters as the detector of the pair, same descriptor
+   layout as the extractor (SURF: extended flag) */
+
+static cv::Feature2D *newSiftFeatures() { return new cv::SIFT(0, 3, 0.1, 15, 2); }
+static cv::Feature2D *newSurfFeatures() { return new cv::SURF(1800, 6, 3, false); }
+static cv::Feature2D *newSurf128Features() { return new cv::SURF(1800, 6, 3, true); }
+static cv::Feature2D *newBriskFeatures() { return new cv::BRISK(); }
+
+static cv::Feature2D *newOrbFeatures()
+{
+  return new cv::ORB(200, 1.4f, 5, 60, 2, 2, cv::ORB::HARRIS_SCORE, 60);
+}
+
+/** \struct FusedEntry
+ *  Entry of the registry of detector/extractor pairs which can share their intermediate data
+ */
+struct FusedEntry
+{
+  const char *detector;
+  const char *extractor;
+  cv::Feature2D *(*create)();
+};
+
+static const FusedEntry FUSED[] = {
+  { "SIFT", "SIFT", newSiftFeatures },        { "SURF", "SURF", newSurfFeatures },
+  { "SURF", "SURF_128", newSurf128Features }, { "BRISK", "BRISK", newBriskFeatures },
+  { "ORB", "ORB", newOrbFeatures },
+};
+
+cv::Ptr< cv::FeatureDetector > FeatureTypes::createDetector(const std::string &name)
+{
+  for (unsigned i = 0; i < sizeof(DETECTORS) / sizeof(DETECTORS[0]); i++)
+  {
+    if (name == DETECTORS[i].name)
+      return cv::Ptr< cv::FeatureDetector >(DETECTORS[i].create());
+  }
+  return cv::Ptr< cv::FeatureDetector >();
+}
+
+cv::Ptr< cv::DescriptorExtractor > FeatureTypes::createExtractor(const std::string &name,
+                                                                 DescriptorInfo &info, bool quantize)
+{
+  for (unsigned i = 0; i < sizeof(EXTRACTORS) / sizeof(EXTRACTORS[0]); i++)
+  {
+    if (name == EXTRACTORS[i].name)
+    {
+      info.name           = EXTRACTORS[i].name;
+      info.size           = EXTRACTORS[i].size;
+      info.type           = EXTRACTORS[i].type;
+      info.norm           = EXTRACTORS[i].norm;
+      info.dist_threshold = EXTRACTORS[i].dist_threshold;
+      info.quantization   = 0.0;
+      if (quantize && EXTRACTORS[i].quantization > 0)
+      {
+        info.type           = CV_8U;
+        info.quantization   = EXTRACTORS[i].quantization;
+        info.dist_threshold = EXTRACTORS[i].dist_threshold * EXTRACTORS[i].quantization;
+      }
+      return cv::Ptr< cv::DescriptorExtractor >(EXTRACTORS[i].create());
+    }
+  }
+  return cv::Ptr< cv::DescriptorExtractor >();
+}
+
+cv::Ptr< cv::Feature2D > FeatureTypes::createFeatures(const std::string &detector_name,
+                                                      const std::string &extractor_name)
+{
+  for (unsigned i = 0; i < sizeof(FUSED) / sizeof(FUSED[0]); i++)
+  {
+    if (detector_name == FUSED[i].detector && extractor_name == FUSED[i].extractor)
+      return cv::Ptr< cv::Feature2D >(FUSED[i].create());
+  }
+  return cv::Ptr< cv::Feature2D >();
+}
+
+bool FeatureTypes::init()
+{
+  std::string detector_name  = DEFAULT_DETECTOR;
+  std::string extractor_name = DEFAULT_EXTRACTOR;
+  if (!ros::param::get("feature_detector", detector_name))
+    ROS_INFO("No value found for `feature_detector` in parameters, using %s", detector_name.c_str());
+  if (!ros::param::get("descriptor_extractor", extractor_name))
+    ROS_INFO("No value found for `descriptor_extractor` in parameters, using %s", extractor_name.c_str());
+  ros::param::get("brute_force_matching", _brute_force);
+  ros::param::get("quantize_descriptors", _quantize);
+  ros::param::get("fused_detection", _fused);
+  ROS_INFO("Descriptor matching: %s", _brute_force ? "brute force" : "FLANN");
+  if (_brute_force)
+    ROS_INFO("Descriptor distance kernels: %s", DescriptorDistance::implementation());
+  return init(detector_name, extractor_name);
+}
+
+bool FeatureTypes::init(const std::string &detector_name, const std::string &extractor_name)
+{
+  cv::Ptr< cv::FeatureDetector > detector = createDetector(detector_name);
+  if (detector.empty())
+  {
+    ROS_ERROR("Unknown feature_detector `%s`, using %s", detector_name.c_str(), DEFAULT_DETECTOR.c_str());
+    init(DEFAULT_DETECTOR, extractor_name);
+    return false;
+  }
+
+  DescriptorInfo info;
+  cv::Ptr< cv::DescriptorExtractor > extractor = createExtractor(extractor_name, info, _quantize);
+  if (extractor.empty())
+  {
+    ROS_ERROR("Unknown descriptor_extractor `%s`, using %s", extractor_name.c_str(), DEFAULT_EXTRACTOR.c_str());
+    init(detector_name, DEFAULT_EXTRACTOR);
+    return false;
+  }
+
+  _detector_name = detector_name;
+  _detector      = detector;
+  _extractor     = extractor;
+  _descriptor    = info;
+  _features      = _fused ? createFeatures(detector_name, extractor_name) : cv::Ptr< cv::Feature2D >();
+  ROS_INFO("Features: %s detector, %s extractor (%d x %s%s, threshold %f)", _detector_name.c_str(),
+           _descriptor.name.c_str(), _descriptor.size, _descriptor.type == CV_8U ? "uint8" : "float",
+           _descriptor.quantization > 0 ? ", quantized" : "", _descriptor.dist_threshold);
+  if (!_features.empty())
+    ROS_INFO("Keypoints are detected and described in a single pass");
+  return true;
+}
+
+cv::Ptr< cv::DescriptorMatcher > FeatureTypes::createMatcher()
+{
+  if (is_binary())
+    return cv::Ptr< cv::DescriptorMatcher >(
+        new cv::FlannBasedMatcher(new cv::flann::LshIndexParams(20, 10, 2)));
+  return cv::Ptr< cv::DescriptorMatcher >(new cv::FlannBasedMatcher());
+}
+
+void FeatureTypes::compute(const cv::Mat &image, std::vector< cv::KeyPoint > &keypoints,
+                           cv::Mat &descriptors)
+{
+  extractor().compute(image, keypoints, descriptors);
+  if (_descriptor.quantization > 0 && descriptors.type() != _descriptor.type)
+    descriptors.convertTo(descriptors, _descriptor.type, _descriptor.quantization);  // saturated
+}
+
+void FeatureTypes::detectAndCompute(const cv::Mat &image, const cv::Mat &mask,
+                                    std::vector< cv::KeyPoint > &keypoints, cv::Mat &descriptors)
+{
+  if (_features.empty())
+  {
+    ROS_ERROR("FeatureTypes::detectAndCompute used with %s detector and %s extractor, which are not fused",
+              _detector_name.c_str(), _descriptor.name.c_str());
+    detector().detect(image, keypoints, mask);
+    compute(image, keypoints, descriptors);
+    return;
+  }
+  (*_features)(image, mask, keypoints, descriptors);
+  if (_descriptor.quantization > 0 && descriptors.type() != _descriptor.type)
+    descriptors.convertTo(descriptors, _descriptor.type, _descriptor.quantization);  // saturated
+}
+
+cv::Mat FeatureTypes::indexable(const cv::Mat &descriptors)
+{
+  if (is_binary() || descriptors.type() == CV_32F)
+    return descriptors;
+  cv::Mat float_descriptors;
+  descriptors.convertTo(float_descriptors, CV_32F);
+  return float_descriptors;
+}
+
+cv::Ptr< cv::flann::Index > FeatureTypes::createIndex(const cv::Mat &indexed)
+{
+  // KD-trees for real descriptors, LSH for binary ones (same as createMatcher)
+  if (is_binary())
+    return cv::Ptr< cv::flann::Index >(new cv::flann::Index(indexed, cv::flann::LshIndexParams(20, 10, 2),
+                                                             cvflann::FLANN_DIST_HAMMING));
+  return cv::Ptr< cv::flann::Index >(
+      new cv::flann::Index(indexed, cv::flann::KDTreeIndexParams(4), cvflann::FLANN_DIST_L2));
+}
+
+void FeatureTypes::match(const cv::Mat &query, const cv::Mat &train, std::vector< cv::DMatch > &matches)
+{
+  if (_brute_force)
+    bruteForceMatch(query, train, matches, norm_type());
+  else
+    createMatcher()->match(indexable(query), indexable(train), matches);
+}
+
+void FeatureTypes::knnMatch(const cv::Mat &query, const cv::Mat &train,
+                            std::vector< std::vector< cv::DMatch > > &matches, int k,
+                            const std::vector< char > *query_valid, const std::vector< char > *train_valid)
+{
+  if (_brute_force)
+  {
+    // the masks are applied in the distance loop, without copying the rows
+    bruteForceKnnMatch(query, train, matches, k, norm_type(), query_valid, train_valid);
+    return;
+  }
+
+  // the index is built for this search only: it holds the valid train rows
+  std::vector< int > train_rows;
+  cv::Mat valid_train = train;
+  if (train_valid)
+  {
+    valid_train = cv::Mat(0, train.cols, train.type());
+    for (int j = 0; j < train.rows; j++)
+    {
+      if ((*train_valid)[j])
+      {
+        train_rows.push_back(j);
+        valid_train.push_back(train.row(j));
+      }
+    }
+  }
+  k = std::min(k, valid_train.rows);  // FLANN cannot search more neighbours than rows
+  if (k == 0)
+  {
+    matches.clear();
+    matches.resize(query.rows);
+    return;
+  }
+  cv::Mat indexed = indexable(valid_train);
+  cv::Ptr< cv::flann::Index > index = createIndex(indexed);
+  flannKnnMatch(*index, query, matches, k, norm_type());
+  for (unsigned i = 0; i < matches.size(); i++)
+  {
+    if (query_valid && !(*query_valid)[i])
+      matches[i].clear();
+    for (unsigned n = 0; train_valid && n < matches[i].size(); n++)
+      matches[i][n].trainIdx = train_rows[matches[i][n].trainIdx];
+  }
+}
+
+const cv::FeatureDetector &FeatureTypes::detector()
+{
+  if (_detector.empty())
+  {
+    ROS_ERROR("FeatureTypes used before FeatureTypes::init()");
+    init(DEFAULT_DETECTOR, DEFAULT_EXTRACTOR);
+  }
+  return *_detector;
+}
+
+const cv::DescriptorExtractor &FeatureTypes::extractor()
+{
+  if (_extractor.empty())
+  {
+    ROS_ERROR("FeatureTypes used before FeatureTypes::init()");
+    init(DEFAULT_DETECTOR, DEFAULT_EXTRACTOR);
+  }
+  return *_extractor;
+}
+
+const DescriptorInfo &FeatureTypes::descriptor()
+{
+  if (_extractor.empty())
+  {
+    ROS_ERROR("FeatureTypes used before FeatureTypes::init()");
+    init(DEFAULT_DETECTOR, DEFAULT_EXTRACTOR);
+  }
+  return _descriptor;
+}
+
+std::string FeatureTypes::detector_name()
+{
+  return _detector_name;
+}
+
+std::string FeatureTypes::extractor_name()
+{
+  return descriptor().name;
+}
+
+int FeatureTypes::descriptor_size()
+{
+  return descriptor().size;
+}
+
+int FeatureTypes::descriptor_type()
+{
+  return descriptor().type;
+}
+
+int FeatureTypes::norm_type()
+{
+  return descriptor().norm;
+}
+
+double FeatureTypes::dist_threshold()
+{
+  return descriptor().dist_threshold;
+}
+
+bool FeatureTypes::is_binary()
+{
+  return descriptor().norm == cv::NORM_HAMMING;
+}
+
+bool FeatureTypes::brute_force()
+{
+  return _brute_force;
+}
+
+bool FeatureTypes::fused()
+{
+  return !_features.empty();
+}
+
+std::string FeatureTypes::parameters()
+{
+  cv::FileStorage fs(".yml", cv::FileStorage::WRITE + cv::FileStorage::MEMORY);
+  fs << "detector" << _detector_name << "extractor" << _descriptor.name;
+  fs << "quantization" << _descriptor.quantization;
+  if (fused())
+  {
+    fs << "features" << "{";
+    _features->write(fs);
+    fs << "}";
+  }
+  else
+  {
+    fs << "detector_params" << "{";
+    _detector->write(fs);
+    fs << "}" << "extractor_params" << "{";
+    _extractor->write(fs);
+    fs << "}";
+  }
+  return fs.releaseAndGetString();
+}
@@ -0,0 +1,130 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/grid_detector.h>
+#include <ucl_drone/computer_vision/feature_types.h>
+
+bool GridDetector::_enabled  = false;
+int GridDetector::_rows         = 4;
+int GridDetector::_cols         = 6;
+int GridDetector::_overlap      = 24;
+int GridDetector::_max_per_cell = 10;
+
+void GridDetector::init()
+{
+  ros::param::get("~grid_detection", _enabled);
+  ros::param::get("~grid_rows", _rows);
+  ros::param::get("~grid_cols", _cols);
+  ros::param::get("~grid_overlap", _overlap);
+  ros::param::get("~grid_max_per_cell", _max_per_cell);
+  if (_rows < 1 || _cols < 1 || _overlap < 0 || _max_per_cell < 1)
+  {
+    ROS_ERROR("Invalid detection grid (%d x %d cells, overlap %d, %d keypoints per cell), grid "
+              "detection disabled", _rows, _cols, _overlap, _max_per_cell);
+    _enabled = false;
+  }
+  if (_enabled)
+    ROS_INFO("Grid detection: %d x %d cells, overlap %d px, %d keypoints per cell", _rows, _cols,
+             _overlap, _max_per_cell);
+}
+
+/** \class CellDetection
+ *  Detection of one cell per iteration of cv::parallel_for_
+ */
+class CellDetection : public cv::ParallelLoopBody
+{
+private:
+  const cv::Mat &image;
+  const cv::Mat &mask;
+  std::vector< std::vector< cv::KeyPoint > > &cells;  //!< keypoints found in each cell
+
+public:
+  CellDetection(const cv::Mat &image, const cv::Mat &mask,
+                std::vector< std::vector< cv::KeyPoint > > &cells)
+    : image(image), mask(mask), cells(cells)
+  {
+  }
+
+  void operator()(const cv::Range &range) const
+  {
+    for (int i = range.start; i < range.end; i++)
+    {
+      int r = i / GridDetector::cols();
+      int c = i % GridDetector::cols();
+      cv::Rect cell(c * image.cols / GridDetector::cols(), r * image.rows / GridDetector::rows(), 0, 0);
+      cell.width  = (c + 1) * image.cols / GridDetector::cols() - cell.x;
+      cell.height = (r + 1) * image.rows / GridDetector::rows() - cell.y;
+
+      if (!mask.empty() && cv::countNonZero(mask(cell)) == 0)
+        continue;
+
+      // the tile is the cell enlarged by the overlap, cut at the image borders
+      int ov = GridDetector::overlap();
+      cv::Rect tile(cell.x - ov, cell.y - ov, cell.width + 2 * ov, cell.height + 2 * ov);
+      tile &= cv::Rect(0, 0, image.cols, image.rows);
+
+      std::vector< cv::KeyPoint > tile_keypoints;
+      if (mask.empty())
+        FeatureTypes::detector().detect(image(tile), tile_keypoints);
+      else
+        FeatureTypes::detector().detect(image(tile), tile_keypoints, mask(tile));
+
+      // keep the keypoints belonging to this cell only (the overlap belongs to the neighbours)
+      std::vector< cv::KeyPoint > &kps = cells[i];
+      for (unsigned k = 0; k < tile_keypoints.size(); k++)
+      {
+        cv::KeyPoint kp = tile_keypoints[k];
+        kp.pt.x += tile.x;
+        kp.pt.y += tile.y;
+        if (cell.contains(kp.pt))
+          kps.push_back(kp);
+      }
+      cv::KeyPointsFilter::retainBest(kps, GridDetector::max_per_cell());
+      if (kps.size() > (size_t)GridDetector::max_per_cell())  // retainBest keeps ties
+        kps.resize(GridDetector::max_per_cell());
+    }
+  }
+};
+
+void GridDetector::detect(const cv::Mat &image, std::vector< cv::KeyPoint > &keypoints,
+                          const cv::Mat &mask)
+{
+  std::vector< std::vector< cv::KeyPoint > > cells(_rows * _cols);
+  cv::parallel_for_(cv::Range(0, _rows * _cols), CellDetection(image, mask, cells));
+
+  keypoints.clear();
+  for (unsigned i = 0; i < cells.size(); i++)
+    keypoints.insert(keypoints.end(), cells[i].begin(), cells[i].end());
+}
+
+bool GridDetector::enabled()
+{
+  return _enabled;
+}
+
+int GridDetector::rows()
+{
+  return _rows;
+}
+
+int GridDetector::cols()
+{
+  return _cols;
+}
+
+int GridDetector::overlap()
+{
+  return _overlap;
+}
+
+int GridDetector::max_per_cell()
+{
+  return _max_per_cell;
+}
@@ -10,21 +10,25 @@
 
 #include <ucl_drone/computer_vision/image_processor.h>
 
-ImageProcessor::ImageProcessor() : it(nh)
+//! \return a node handle whose callbacks are called from queue
+static ros::NodeHandle queuedHandle(ros::CallbackQueue* queue, const std::string& ns = "")
 {
-  std::string cam_type;       // bottom or front
-  std::string video_channel_;  // path to the undistorted video channel
+  ros::NodeHandle nh(ns);
+  nh.setCallbackQueue(queue);
+  return nh;
+}
 
+void ImageProcessor::initShared()
+{
   cv::initModule_nonfree();  // initialize the opencv module which contains SIFT and SURF
+  FeatureTypes::init();      // build the detector and extractor selected in the launch file
+  GridDetector::init();      // read the detection grid parameters
 
-  // Get all parameters from the launch file
-  bool autonomy_unavailable = false;  // true if the ardrone_autonomy node is not launched
-  ros::param::get("~autonomy_unavailable", autonomy_unavailable);
-  ros::param::get("~use_OpticalFlowPyrLK", this->use_OpticalFlowPyrLK);
-  ros::param::get("~cam_type", cam_type);
-  if      (cam_type == "front")  video_channel_ = "ardrone/front/image_raw";
-  else if (cam_type == "bottom") video_channel_ = "ardrone/bottom/image_raw";
-  ros::param::get("~video_channel", video_channel_);
+  // Tracking fails (and a full detection is made) below these numbers of keypoints
+  ros::param::get("~min_tracked_ratio", ProcessedImage::min_tracked_ratio);
+  ros::param::get("~min_tracked_keypoints", ProcessedImage::min_tracked);
+  // Grayscale pipeline: one channel from the reception of the image to the published image
+  ros::param::get("~mono", ProcessedImage::mono);
 
   // Read camera calibration coefficients in the launch file
   if (!Read::CamMatrixParams("cam_matrix"))
@@ -35,6 +39,63 @@ ImageProcessor::ImageProcessor() : it(nh)
   {
     ROS_ERROR("img_size not properly transmitted");
   }
+}
+
+ImageProcessor::ImageProcessor(const std::string& cam_name, const std::string& output_ns,
+                               const TargetSet* shared_targets)
+  : cam_name(cam_name)
+  , nh(queuedHandle(&callback_queue))
+  , out_nh(queuedHandle(&callback_queue, output_ns))
+  , it(nh)
+  , decode_queue(pipeline_queue_size)
+  , track_queue(pipeline_queue_size)
+  , describe_queue(pipeline_queue_size)
+  , target_queue(pipeline_queue_size)
+  , publish_queue(pipeline_queue_size)
+{
+  std::string cam_type = cam_name; // bottom or front
+  std::string video_channel_;       // path to the video channel (raw images are rectified with camera_info)
+
+  scheduler.init(cam_name);  // read the latency budget of the keypoints mode
+
+  // Get all parameters from the launch file (~<cam_name>/<param>, or ~<param> if not set)
+  bool autonomy_unavailable = false;  // true if the ardrone_autonomy node is not launched
+  getParam("autonomy_unavailable", autonomy_unavailable);
+  getParam("use_OpticalFlowPyrLK", this->use_OpticalFlowPyrLK);
+  this->use_pipeline = false;
+  getParam("use_pipeline", this->use_pipeline);
+  this->event_driven = false;
+  getParam("event_driven", this->event_driven);
+  this->max_frame_age = 0.2;
+  getParam("max_frame_age", this->max_frame_age);
+  std::string image_payload_ = "reference";
+  getParam("image_payload", image_payload_);
+  if      (image_payload_ == "none")       image_payload = ucl_drone::ProcessedImageMsg::IMAGE_NONE;
+  else if (image_payload_ == "raw")        image_payload = ucl_drone::ProcessedImageMsg::IMAGE_RAW;
+  else if (image_payload_ == "compressed") image_payload = ucl_drone::ProcessedImageMsg::IMAGE_COMPRESSED;
+  else
+  {
+    if (image_payload_ != "reference")
+      ROS_ERROR("Unknown image_payload `%s`, using reference", image_payload_.c_str());
+    image_payload = ucl_drone::ProcessedImageMsg::IMAGE_REFERENCE;
+  }
+  this->image_format = "jpeg";
+  getParam("image_format", this->image_format);
+  this->image_quality = this->image_format == "png" ? 3 : 80;
+  getParam("image_quality", this->image_quality);
+  this->async_targets = false;
+  getParam("async_targets", this->async_targets);
+  this->target_rate = 5.0;
+  getParam("target_rate", this->target_rate);
+  getCameraParam("cam_type", cam_type);  // a named camera does not take the type of the other ones
+  if      (cam_type == "front")  video_channel_ = "ardrone/front/image_raw";
+  else if (cam_type == "bottom") video_channel_ = "ardrone/bottom/image_raw";
+  getParam("video_channel", video_channel_);
+  // calibration of the camera: raw images are then rectified here (no image_proc node needed)
+  std::string camera_info;
+  getParam("camera_info", camera_info);
+  if (!camera_info.empty())
+    rectifier.init(camera_info, cv::Size(Read::img_width(), Read::img_height()));
 
   // Subscribers
   video_channel          = nh.resolveName(video_channel_);
@@ -46,9 +107,22 @@ ImageProcessor::ImageProcessor() : it(nh)
   reset_pose_sub     = nh.subscribe(reset_pose_channel,     1, &ImageProcessor::resetPoseCb,    this);
   end_reset_pose_sub = nh.subscribe(end_reset_pose_channel, 1, &ImageProcessor::endResetPoseCb, this);
 
-  // Initialize publisher of processed_image
-  processed_image_channel_out = nh.resolveName("processed_image");
-  processed_image_pub = nh.advertise<ucl_drone::ProcessedImageMsg>(processed_image_channel_out, 1);
+  // Initialize publisher of processed_image (in the output namespace of this camera)
+  processed_image_channel_out = out_nh.resolveName("processed_image");
+  processed_image_pub = out_nh.advertise<ucl_drone::ProcessedImageMsg>(processed_image_channel_out, 1);
+  dropped_frames_channel_out = out_nh.resolveName("processed_image/dropped_frames");
+  dropped_frames_pub = out_nh.advertise<std_msgs::UInt32>(dropped_frames_channel_out, 1);
+  // images referenced by processed_image (latched: a node subscribing late gets the last one)
+  image_channel_out = out_nh.resolveName("processed_image/image");
+  image_pub = out_nh.advertise<sensor_msgs::Image>(image_channel_out, 1, true);
+  compressed_image_channel_out = out_nh.resolveName("processed_image/image/compressed");
+  compressed_image_pub = out_nh.advertise<sensor_msgs::CompressedImage>(compressed_image_channel_out, 1, true);
+  targets_channel_out = out_nh.resolveName("processed_image/targets");
+  targets_pub = out_nh.advertise<ucl_drone::TargetsMsg>(targets_channel_out, 10);
+  scheduler_channel_out = out_nh.resolveName("processed_image/scheduler");
+  scheduler_pub = out_nh.advertise<ucl_drone::ModeDecision>(scheduler_channel_out, 10);
+  ROS_INFO("ImageProcessor%s%s: %s -> %s", cam_name.empty() ? "" : " ", cam_name.c_str(), video_channel.c_str(),
+           processed_image_channel_out.c_str());
 
   if (!autonomy_unavailable)  // then set the drone to the selected camera
   {
@@ -56,20 +130,48 @@ ImageProcessor::ImageProcessor() : it(nh)
   }
 
 
-  // Initialize an empty processed_image
-  this->prev_cam_img = new ProcessedImage();
+  // The first image is processed in slot 1, slot 0 stays empty
+  prev_slot = 0;
   #ifdef DEBUG_TARGET
     cv::namedWindow(OPENCV_WINDOW);
   #endif /* DEBUG_TARGET */
 
-  // Load and initialize the target object
-  target_loaded = target.init(TARGET_RELPATH);
+  // Load and initialize the targets (list of pictures in the package, default TARGET_RELPATH),
+  // or share the targets of the other cameras if this one has no ~<cam_name>/targets (the tracking
+  // state stays per camera)
+  bool detect_targets = true;
+  getParam("detect_targets", detect_targets);
+  std::vector<std::string> target_paths(1, TARGET_RELPATH);
+  if (!detect_targets)
+    target_loaded = false;
+  else if (shared_targets && !getCameraParam("targets", target_paths))
+  {
+    targets = *shared_targets;
+    target_loaded = targets.size() > 0;
+  }
+  else
+  {
+    getParam("targets", target_paths);
+    target_loaded = targets.init(target_paths);
+  }
 
   pose_publishing  = false;
   video_publishing = false;
   pending_reset    = false;
-  last_full_detection   = ros::Time::now() - ros::Duration(100.0);
-  last_hybrid_detection = ros::Time::now() - ros::Duration(100.0);
+  new_image        = false;
+  dropped_frames   = 0;
+  dropped_frames_total = 0;
+
+  prev_reset = false;
+  target_stop = false;
+  async_targets = async_targets && target_loaded;
+  if (async_targets)
+  {
+    ROS_INFO("ImageProcessor: targets searched on their own thread (at most %.1f Hz)", target_rate);
+    target_thread = boost::thread(boost::bind(&ImageProcessor::targetWorker, this));
+  }
+  if (use_pipeline)
+    startPipeline();
 }
 
 void ImageProcessor::setCamChannel(std::string cam_type)
@@ -98,16 +200,26 @@ void ImageProcessor::setCamChannel(std::string cam_type)
 
 ImageProcessor::~ImageProcessor()
 {
+  stopPipeline();
+  {
+    boost::mutex::scoped_lock lock(target_mutex);
+    target_stop = true;
+    target_cond.notify_all();
+  }
+  if (target_thread.joinable())
+    target_thread.join();
 #ifdef DEBUG_TARGET
   cv::destroyWindow(OPENCV_WINDOW);
 #endif /* DEBUG_TARGET */
-  delete this->prev_cam_img;
+  for (unsigned i = 0; i < free_slots.size(); i++)
+    delete free_slots[i];
 }
 
 void ImageProcessor::resetPoseCb(const std_msgs::Empty& msg)
 {
   pending_reset = true;
-  this->prev_cam_img = new ProcessedImage();
+  boost::mutex::scoped_lock lock(reset_mutex);
+  prev_reset = true;
 }
 
 void ImageProcessor::endResetPoseCb(const std_msgs::Empty& msg)
@@ -121,8 +233,13 @@ void ImageProcessor::imageCb(const sensor_msgs::Image::ConstPtr& msg)
   if (pending_reset)
     return;
   ROS_DEBUG("ImageProcessor::imageCb");
+  boost::mutex::scoped_lock lock(image_mutex);
+  if (event_driven && new_image) // the previous image was not processed in time
+    dropped_frames++;
   lastImageReceived = msg;
+  new_image = true;
   video_publishing = true;
+  image_cond.notify_one();
 }
 
 /* This function is called every time a new pose is published */
@@ -131,51 +248,169 @@ void ImageProcessor::poseCb(const ucl_drone::Pose3D::ConstPtr& posePtr)
   if (pending_reset)
     return;
   ROS_DEBUG("ImageProcessor::poseCb");
+  boost::mutex::scoped_lock lock(image_mutex);
   lastPoseReceived = posePtr;
   pose_publishing = true;
+  if (new_image) // an image may be waiting for its first pose
+    image_cond.notify_one();
+}
+
+void ImageProcessor::run()
+{
+  // rate of this node
+  //ros::Rate r(6);  // 12Hz =  average frequency at which we receive images
+  //ros::Rate r(15);  // 12Hz =  average frequency at which we receive images
+  ros::Rate r(20);
+
+  // wait until pose and video are available
+  while ((!pose_publishing || !video_publishing) && ros::ok())
+  {
+    callback_queue.callAvailable();
+    r.sleep();
+  }
+
+  if (event_driven)
+  {
+    // callbacks run on their own thread, each image is processed as soon as it is received
+    ros::AsyncSpinner spinner(1, &callback_queue);
+    spinner.start();
+    while (ros::ok())
+      processNextImage();
+    return;
+  }
+
+  while (ros::ok())  // while the node is not killed by Ctrl-C
+  {
+    callback_queue.callAvailable();
+    publishProcessedImg();
+    r.sleep();
+  }
 }
 
 /* This function is called at every loop of the current node */
 void ImageProcessor::publishProcessedImg()
 {
-  TIC(imageprocessor);
   if (pending_reset)
     return;
-  ROS_DEBUG("ImageProcessor::publishProcessedImg");
+  processImage(lastImageReceived, lastPoseReceived);
+}
+
+/* This function is called in a loop of the current node, in event-driven mode */
+void ImageProcessor::processNextImage()
+{
+  sensor_msgs::Image::ConstPtr image_msg;
+  ucl_drone::Pose3D::ConstPtr pose_msg;
+  unsigned dropped;
+  {
+    boost::mutex::scoped_lock lock(image_mutex);
+    while (!(new_image && lastPoseReceived))
+    {
+      // wake up regularly to let the node stop
+      image_cond.timed_wait(lock, boost::posix_time::milliseconds(100));
+      if (!ros::ok())
+        return;
+    }
+    image_msg = lastImageReceived;
+    pose_msg  = lastPoseReceived;
+    new_image = false;
+    dropped   = dropped_frames;
+    dropped_frames = 0;
+  }
+  if (pending_reset)
+    return;
+
+  // an image which waited too long is useless to the pose estimation
+  if (max_frame_age > 0 && !image_msg->header.stamp.isZero()
+      && ros::Time::now() - image_msg->header.stamp > ros::Duration(max_frame_age))
+  {
+    ROS_DEBUG("ImageProcessor: stale image dropped");
+    dropped++;
+    image_msg.reset();
+  }
+  if (dropped > 0)
+    countDroppedFrames(dropped);
+  if (image_msg)
+    processImage(image_msg, pose_msg);
+}
+
+void ImageProcessor::countDroppedFrames(unsigned n)
+{
+  dropped_frames_total += n;
+  std_msgs::UInt32 msg;
+  msg.data = dropped_frames_total;
+  dropped_frames_pub.publish(msg);
+}
+
+void ImageProcessor::reportMode(int OF_mode, const std::string& reason, const ProcessedImage& img,
+                                bool made_full_detection, const ros::WallTime& start)
+{
+  ucl_drone::ModeDecision msg;
+  scheduler.update(OF_mode, reason, img, made_full_detection, (ros::WallTime::now() - start).toSec(), msg);
+  scheduler_pub.publish(msg);
+}
+
+void ImageProcessor::processImage(const sensor_msgs::Image::ConstPtr& image_msg,
+                                  const ucl_drone::Pose3D::ConstPtr& pose_msg)
+{
+  TIC(imageprocessor);
+  ROS_DEBUG("ImageProcessor::processImage");
+
+  if (use_pipeline)
+  {
+    // Each image enters the pipeline once. If the first stage is still busy, the image is dropped
+    if (image_msg == last_image_queued)
+      return;
+    PipelineItemPtr item(new PipelineItem);
+    item->image_msg = image_msg;
+    item->pose_msg  = pose_msg;
+    item->start     = ros::WallTime::now();
+    if (!decode_queue.tryPush(item))
+    {
+      ROS_DEBUG("ImageProcessor: pipeline is full, image dropped");
+      countDroppedFrames(1);
+    }
+    last_image_queued = image_msg;
+    return;
+  }
+
+  {
+    boost::mutex::scoped_lock lock(reset_mutex);
+    if (prev_reset)
+    {
+      cam_img_slots[prev_slot].clear();
+      prev_reset = false;
+    }
+  }
+
+  ros::WallTime start = ros::WallTime::now();
 
   // give all data to process the last image received (keypoints and target detection)
   //ProcessedImage cam_img(*lastImageReceived, *lastPoseReceived, *prev_cam_img, use_OpticalFlowPyrLK);
-  int OF_mode;
-  if (ros::Time::now() - last_full_detection > ros::Duration(10.0)||!prev_cam_img->cv_img||prev_cam_img->n_pts < 20)
-  {//Full detection
-    OF_mode = -1;
-    last_full_detection   = ros::Time::now();
-    last_hybrid_detection = ros::Time::now();
-  }
-  //else if (ros::Time::now() - last_hybrid_detection > ros::Duration(3.0))
-  //{//forced hybrid
-    //OF_mode = 0;
-    //last_hybrid_detection = ros::Time::now();
-  //}
-  else OF_mode = 1; //Tracking, with detection on the sides when necessary
-  bool test = false;
-  ProcessedImage cam_img(*lastImageReceived, *lastPoseReceived, *prev_cam_img, OF_mode, test);
-  if (test&&OF_mode!=-1) ROS_WARN("anomaly");
+  ProcessedImage& prev_cam_img = cam_img_slots[prev_slot];
+  ProcessedImage& cam_img = cam_img_slots[1 - prev_slot];
+  std::string mode_reason;
+  int OF_mode = scheduler.choose(prev_cam_img, mode_reason);
+  bool made_full_detection = false;
+  if (!cam_img.process(*image_msg, *pose_msg, prev_cam_img, OF_mode, made_full_detection, &rectifier))
+    return;
+  if (made_full_detection && OF_mode != -1)
+    ROS_DEBUG("ImageProcessor: tracking failed, full detection made");
 
   // initialize the message to send
   ucl_drone::ProcessedImageMsg::Ptr msg(new ucl_drone::ProcessedImageMsg);
   // build the message to send
-  cam_img.convertToMsg(msg, target);
+  buildMsg(msg, cam_img, prev_cam_img);
+  attachImage(msg, cam_img);
   //TOC(processed_image, "processedImage");
 
   TIC(publish);
   // publish the message
   processed_image_pub.publish(msg);
   //TOC(publish, "publisher");
+  reportMode(OF_mode, mode_reason, cam_img, made_full_detection, start);
 
-  // replace the previous image processed
-  delete this->prev_cam_img;
-  this->prev_cam_img = new ProcessedImage(cam_img);
+  // the image processed becomes the previous one, the old previous slot is reused next time
+  prev_slot = 1 - prev_slot;
   //if (OF_mode == -1)
     //TOC_DISPLAY(imageprocessor,"detection");
   //if (OF_mode == 0)
@@ -184,6 +419,256 @@ void ImageProcessor::publishProcessedImg()
     //TOC_DISPLAY(imageprocessor,"tracking ");
 }
 
+void ImageProcessor::buildMsg(ucl_drone::ProcessedImageMsg::Ptr& msg, ProcessedImage& img,
+                              const ProcessedImage& prev)
+{
+  if (!async_targets)
+  {
+    img.convertToMsg(msg, targets, prev);
+    return;
+  }
+  std::vector<std::vector<cv::Point2f> > areas;
+  {
+    boost::mutex::scoped_lock lock(target_mutex);
+    areas = target_areas;
+  }
+  img.convertToMsg(msg, areas);
+  submitTargets(img);
+}
+
+void ImageProcessor::submitTargets(const ProcessedImage& img)
+{
+  if (!img.cv_img)
+    return;
+  {
+    boost::mutex::scoped_lock lock(target_mutex);
+    if (ros::WallTime::now() < next_target_time)
+      return;
+  }
+
+  TargetJobPtr job(new TargetJob);
+  job->header = img.cv_img->header;
+  job->pose   = img.pose;
+  std::vector<uint32_t> track_ids;
+  img.selectDescribed(job->keypoints, job->descriptors, track_ids);
+  if (img.n_described == img.n_pts)
+  {
+    job->keypoints   = img.keypoints;
+    job->descriptors = img.descriptors.rowRange(0, img.n_pts).clone();
+  }
+  job->gray = img.gray.clone();
+
+  boost::mutex::scoped_lock lock(target_mutex);
+  target_job = job; // an image still waiting is replaced by this newer one
+  target_cond.notify_one();
+}
+
+void ImageProcessor::targetWorker()
+{
+  static const std::vector<cv::Mat> no_pyramid;
+  ros::WallDuration period(target_rate > 0 ? 1.0 / target_rate : 0.0);
+  TargetJobPtr job, prev_job;
+  while (true)
+  {
+    {
+      boost::mutex::scoped_lock lock(target_mutex);
+      while (!target_job && !target_stop)
+        target_cond.wait(lock);
+      if (target_stop)
+        return;
+      job = target_job;
+      target_job.reset();
+      next_target_time = ros::WallTime::now() + period;
+    }
+
+    // targets detected in the previous job are tracked if possible
+    cv::buildOpticalFlowPyramid(job->gray, job->pyramid, cv::Size(TARGET_TRACK_WIN_SIZE, TARGET_TRACK_WIN_SIZE),
+                                TARGET_TRACK_MAX_LEVEL);
+    bool can_track = prev_job && prev_job->gray.size() == job->gray.size();
+    std::vector<TargetDetection> detections;
+    std::vector<int> idxs_to_remove;
+    ucl_drone::TargetsMsg::Ptr msg(new ucl_drone::TargetsMsg);
+    msg->header = job->header;
+    msg->pose   = job->pose;
+    msg->target_detected = targets.detect(job->descriptors, job->keypoints, detections, idxs_to_remove,
+                                          can_track ? prev_job->pyramid : no_pyramid,
+                                          can_track ? job->pyramid : no_pyramid);
+    targets.toMsg(detections, msg->targets);
+    if (msg->target_detected) // the first target detected is also given in target_points
+      msg->target_points = msg->targets[0].target_points;
+    {
+      boost::mutex::scoped_lock lock(target_mutex);
+      target_areas.clear();
+      for (unsigned k = 0; k < detections.size(); k++)
+        target_areas.push_back(detections[k].target_coord);
+    }
+    targets_pub.publish(msg);
+    prev_job = job;
+  }
+}
+
+void ImageProcessor::attachImage(ucl_drone::ProcessedImageMsg::Ptr& msg, const ProcessedImage& img)
+{
+  msg->image_payload = image_payload;
+  switch (image_payload)
+  {
+    case ucl_drone::ProcessedImageMsg::IMAGE_RAW:
+      img.toImageMsg(msg->image);
+      break;
+
+    case ucl_drone::ProcessedImageMsg::IMAGE_COMPRESSED:
+      if (!img.toCompressedImageMsg(msg->compressed_image, image_format, image_quality))
+        msg->image_payload = ucl_drone::ProcessedImageMsg::IMAGE_NONE;
+      break;
+
+    case ucl_drone::ProcessedImageMsg::IMAGE_REFERENCE:
+      // the pixels are only converted if some node listens, before the message referencing them
+      if (image_pub.getNumSubscribers() > 0)
+      {
+        sensor_msgs::ImagePtr image_msg(new sensor_msgs::Image);
+        img.toImageMsg(*image_msg);
+        image_pub.publish(image_msg);
+      }
+      if (compressed_image_pub.getNumSubscribers() > 0)
+      {
+        sensor_msgs::CompressedImagePtr image_msg(new sensor_msgs::CompressedImage);
+        if (img.toCompressedImageMsg(*image_msg, image_format, image_quality))
+          compressed_image_pub.publish(image_msg);
+      }
+      break;
+  }
+}
+
+void ImageProcessor::startPipeline()
+{
+  ROS_INFO("ImageProcessor: starting pipeline (one thread per stage)");
+  pipeline_prev = acquireSlot();
+  pipeline_threads.create_thread(boost::bind(&ImageProcessor::decodeStage,   this));
+  pipeline_threads.create_thread(boost::bind(&ImageProcessor::trackStage,    this));
+  pipeline_threads.create_thread(boost::bind(&ImageProcessor::describeStage, this));
+  pipeline_threads.create_thread(boost::bind(&ImageProcessor::targetStage,   this));
+  pipeline_threads.create_thread(boost::bind(&ImageProcessor::publishStage,  this));
+}
+
+void ImageProcessor::stopPipeline()
+{
+  decode_queue.close();
+  track_queue.close();
+  describe_queue.close();
+  target_queue.close();
+  publish_queue.close();
+  pipeline_threads.join_all();
+
+  // give back the images still held by the pipeline
+  PipelineItemPtr item;
+  while (decode_queue.pop(item)) {}
+  while (track_queue.pop(item)) {}
+  while (describe_queue.pop(item)) {}
+  while (target_queue.pop(item)) {}
+  while (publish_queue.pop(item)) {}
+  item.reset();
+  pipeline_prev.reset();
+}
+
+boost::shared_ptr<ProcessedImage> ImageProcessor::acquireSlot()
+{
+  ProcessedImage* slot = NULL;
+  {
+    boost::mutex::scoped_lock lock(slots_mutex);
+    if (!free_slots.empty())
+    {
+      slot = free_slots.back();
+      free_slots.pop_back();
+    }
+  }
+  if (!slot) // only while the pipeline fills up
+    slot = new ProcessedImage();
+  return boost::shared_ptr<ProcessedImage>(slot, boost::bind(&ImageProcessor::releaseSlot, this, _1));
+}
+
+void ImageProcessor::releaseSlot(ProcessedImage* slot)
+{
+  boost::mutex::scoped_lock lock(slots_mutex);
+  free_slots.push_back(slot);
+}
+
+void ImageProcessor::decodeStage()
+{
+  PipelineItemPtr item;
+  while (decode_queue.pop(item))
+  {
+    item->img = acquireSlot();
+    bool converted = item->img->convertImage(*item->image_msg, *item->pose_msg, &rectifier);
+    item->image_msg.reset();
+    if (!converted)
+      continue;
+    if (!track_queue.push(item))
+      return;
+  }
+}
+
+void ImageProcessor::trackStage()
+{
+  PipelineItemPtr item;
+  while (track_queue.pop(item))
+  {
+    {
+      boost::mutex::scoped_lock lock(reset_mutex);
+      if (prev_reset)
+      {
+        pipeline_prev = acquireSlot();
+        pipeline_prev->clear();
+        prev_reset = false;
+      }
+    }
+    item->made_full_detection = false;
+    item->OF_mode = scheduler.choose(*pipeline_prev, item->mode_reason);
+    item->img->findKeypoints(*pipeline_prev, item->OF_mode, item->made_full_detection);
+    // the next image can be tracked while this one is described
+    item->prev    = pipeline_prev;
+    pipeline_prev = item->img;
+    if (!describe_queue.push(item))
+      return;
+  }
+}
+
+void ImageProcessor::describeStage()
+{
+  PipelineItemPtr item;
+  while (describe_queue.pop(item))
+  {
+    // images are described in order, so the previous one is already described
+    item->img->describeKeypoints(*item->prev);
+    if (!target_queue.push(item))
+      return;
+  }
+}
+
+void ImageProcessor::targetStage()
+{
+  PipelineItemPtr item;
+  while (target_queue.pop(item))
+  {
+    item->msg.reset(new ucl_drone::ProcessedImageMsg);
+    buildMsg(item->msg, *item->img, *item->prev);
+    attachImage(item->msg, *item->img);
+    reportMode(item->OF_mode, item->mode_reason, *item->img, item->made_full_detection, item->start);
+    item->img.reset();
+    item->prev.reset();
+    if (!publish_queue.push(item))
+      return;
+  }
+}
+
+void ImageProcessor::publishStage()
+{
+  PipelineItemPtr item;
+  while (publish_queue.pop(item))
+  {
+    processed_image_pub.publish(item->msg);
+  }
+}
+
 int main(int argc, char** argv)
 {
   ros::init(argc, argv, "computer_vision");
@@ -193,27 +678,35 @@ int main(int argc, char** argv)
   //   ros::console::notifyLoggerLevelsChanged();
   // }
 
-  // initialize the node object
-  ImageProcessor ic;
+  // detector, extractor and parameters shared by all cameras
+  ImageProcessor::initShared();
 
-  // rate of this node
-  //ros::Rate r(6);  // 12Hz =  average frequency at which we receive images
-  //ros::Rate r(15);  // 12Hz =  average frequency at which we receive images
-  ros::Rate r(20);
-
-  // wait until pose and video are available
-  while ((!ic.pose_publishing || !ic.video_publishing) && ros::ok())
+  std::vector<std::string> cameras;
+  ros::param::get("~cameras", cameras);
+  if (cameras.size() <= 1)
   {
-    ros::spinOnce();
-    r.sleep();
+    // initialize the node object
+    ImageProcessor ic(cameras.empty() ? "" : cameras[0]);
+    ic.run();
+    return 0;
   }
 
-  while (ros::ok())  // while the node is not killed by Ctrl-C
-  {
-    ros::spinOnce();
-    ic.publishProcessedImg();
-    r.sleep();
-  }
+  // One pipeline per camera, each on its own thread with its own callbacks. The first camera
+  // publishes processed_image, the other ones <camera>/processed_image
+  TargetSet targets;
+  std::vector<std::string> target_paths(1, TARGET_RELPATH);
+  ros::param::get("~targets", target_paths);
+  targets.init(target_paths);
+
+  std::vector<boost::shared_ptr<ImageProcessor> > processors;
+  for (unsigned i = 0; i < cameras.size(); i++)
+    processors.push_back(boost::make_shared<ImageProcessor>(cameras[i], i == 0 ? "" : cameras[i], &targets));
+  boost::thread_group threads;
+  for (unsigned i = 0; i < processors.size(); i++)
+    threads.create_thread(boost::bind(&ImageProcessor::run, processors[i].get()));
 
+  // the global queue is not used by the cameras
+  ros::spin();
+  threads.join_all();
   return 0;
 }
@@ -0,0 +1,72 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/matching_engine.h>
+
+#include <algorithm>
+
+#include <ucl_drone/computer_vision/feature_types.h>
+
+void filterKnnMatches(const std::vector< std::vector< cv::DMatch > >& knn_matches, int n_train,
+                      const MatchOptions& options, std::vector< cv::DMatch >& matches,
+                      const std::vector< std::vector< cv::DMatch > >* reverse)
+{
+  matches.clear();
+  std::vector< cv::DMatch > candidates;
+  candidates.reserve(knn_matches.size());
+  for (unsigned i = 0; i < knn_matches.size(); i++)
+  {
+    if (knn_matches[i].empty())
+      continue;
+    const cv::DMatch& best = knn_matches[i][0];
+    if (best.distance > options.max_distance)
+      continue;
+    if (options.ratio > 0 && knn_matches[i].size() > 1 &&
+        best.distance >= options.ratio * knn_matches[i][1].distance)
+      continue;
+    if (options.cross_check && reverse)
+    {
+      const std::vector< cv::DMatch >& back = (*reverse)[best.trainIdx];
+      if (back.empty() || back[0].trainIdx != best.queryIdx)
+        continue;
+    }
+    candidates.push_back(best);
+  }
+
+  // closest first, each train descriptor once
+  std::sort(candidates.begin(), candidates.end());
+  std::vector< char > train_used(n_train, 0);
+  unsigned budget = options.max_matches < 0 ? candidates.size() : options.max_matches;
+  matches.reserve(std::min(budget, (unsigned)candidates.size()));
+  for (unsigned k = 0; k < candidates.size() && matches.size() < budget; k++)
+  {
+    if (train_used[candidates[k].trainIdx])
+      continue;
+    train_used[candidates[k].trainIdx] = 1;
+    matches.push_back(candidates[k]);
+  }
+}
+
+void matchUnique(const cv::Mat& query, const cv::Mat& train, const MatchOptions& options,
+                 std::vector< cv::DMatch >& matches, const std::vector< char >* query_valid,
+                 const std::vector< char >* train_valid)
+{
+  matches.clear();
+  if (query.rows == 0 || train.rows == 0)
+    return;
+
+  // ignored rows are left out of the search (see FeatureTypes::knnMatch): the neighbours used by
+  // the ratio test and the cross-check are then only valid ones
+  std::vector< std::vector< cv::DMatch > > knn_matches, reverse;
+  FeatureTypes::knnMatch(query, train, knn_matches, options.ratio > 0 ? 2 : 1, query_valid, train_valid);
+  if (options.cross_check)
+    FeatureTypes::knnMatch(train, query, reverse, 1, train_valid, query_valid);
+  filterKnnMatches(knn_matches, train.rows, options, matches, options.cross_check ? &reverse : NULL);
+}
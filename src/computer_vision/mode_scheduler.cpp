@@ -0,0 +1,133 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/mode_scheduler.h>
+
+ModeScheduler::ModeScheduler()
+  : budget(0.05)
+  , refresh_period(10.0)
+  , min_keypoints(20)
+  , min_keypoints_ratio(0.5)
+  , smoothing(0.2)
+  , base_cost(-1)
+  , reference_pts(0)
+  , last_detection(0)
+{
+  for (int m = 0; m < 3; m++)
+    mode_cost[m] = -1;
+}
+
+//! Read ~<cam_name>/name, or ~name if it is not set
+template < class T >
+static void getParam(const std::string& cam_name, const std::string& name, T& value)
+{
+  if (cam_name.empty() || !ros::param::get("~" + cam_name + "/" + name, value))
+    ros::param::get("~" + name, value);
+}
+
+void ModeScheduler::init(const std::string& cam_name)
+{
+  getParam(cam_name, "latency_budget", budget);
+  getParam(cam_name, "refresh_period", refresh_period);
+  getParam(cam_name, "min_keypoints", min_keypoints);
+  getParam(cam_name, "min_keypoints_ratio", min_keypoints_ratio);
+  getParam(cam_name, "cost_smoothing", smoothing);
+  ROS_INFO("ModeScheduler: latency budget %.0f ms, full detection at least every %.1f s", budget * 1000,
+           refresh_period);
+}
+
+double ModeScheduler::expected(int mode) const
+{
+  if (mode_cost[mode + 1] < 0)
+    return 0;
+  return mode_cost[mode + 1] + (base_cost < 0 ? 0 : base_cost);
+}
+
+bool ModeScheduler::fits(int mode) const
+{
+  return expected(mode) <= budget;
+}
+
+void ModeScheduler::average(double& avg, double measure) const
+{
+  avg = avg < 0 ? measure : (1 - smoothing) * avg + smoothing * measure;
+}
+
+int ModeScheduler::choose(const ProcessedImage& prev, std::string& reason)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  const int DETECTION = ucl_drone::ModeDecision::DETECTION;
+  const int HYBRID    = ucl_drone::ModeDecision::HYBRID;
+  const int TRACKING  = ucl_drone::ModeDecision::TRACKING;
+
+  // nothing to track from
+  if (!prev.cv_img || prev.n_pts < min_keypoints)
+  {
+    reason = "not enough keypoints to track";
+    return DETECTION;
+  }
+
+  double since_detection = (ros::Time::now() - last_detection).toSec();
+  bool refresh = since_detection > refresh_period;
+  bool lost    = prev.n_pts < min_keypoints_ratio * reference_pts;
+  if (!refresh && !lost)
+  {
+    reason = "enough keypoints tracked";
+    return TRACKING;
+  }
+
+  // the richest mode within the budget
+  if (fits(DETECTION))
+  {
+    reason = refresh ? "periodic full detection" : "keypoints lost";
+    return DETECTION;
+  }
+  if (lost && fits(HYBRID))
+  {
+    reason = "keypoints lost, full detection over budget";
+    return HYBRID;
+  }
+  // the map must not rely on the same keypoints forever
+  if (since_detection > 2 * refresh_period)
+  {
+    reason = "full detection overdue, over budget";
+    return DETECTION;
+  }
+  reason = "over budget";
+  return TRACKING;
+}
+
+void ModeScheduler::update(int mode, const std::string& reason, const ProcessedImage& img,
+                           bool made_full_detection, double latency, ucl_drone::ModeDecision& msg)
+{
+  boost::mutex::scoped_lock lock(mutex);
+  int mode_used = made_full_detection ? (int)ucl_drone::ModeDecision::DETECTION : mode;
+  average(mode_cost[mode_used + 1], img.keypoints_time);
+  average(base_cost, std::max(0.0, latency - img.keypoints_time));
+  if (made_full_detection)
+  {
+    last_detection = ros::Time::now();
+    reference_pts  = img.n_pts;
+  }
+
+  if (img.cv_img)
+    msg.header = img.cv_img->header;
+  msg.mode           = mode;
+  msg.mode_used      = mode_used;
+  msg.reason         = reason;
+  msg.budget         = budget;
+  msg.latency        = latency;
+  msg.keypoints_time = img.keypoints_time;
+  for (int m = 0; m < 3; m++)
+    msg.mode_cost[m] = mode_cost[m];
+  msg.base_cost   = base_cost;
+  msg.n_keypoints = img.n_pts;
+  msg.n_tracked   = img.n_tracked;
+}
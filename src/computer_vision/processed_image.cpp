@@ -11,11 +11,27 @@
 
 #include <ucl_drone/computer_vision/processed_image.h>
 
+double ProcessedImage::min_tracked_ratio = 0.75;
+int    ProcessedImage::min_tracked       = 80;
+bool   ProcessedImage::mono              = false;
+uint32_t ProcessedImage::next_track_id = 1;
+boost::mutex ProcessedImage::track_id_mutex;
+
 // Contructor for the empty object
 ProcessedImage::ProcessedImage()
 {
-  ucl_drone::ProcessedImageMsg::Ptr msg(new ucl_drone::ProcessedImageMsg());
-  n_pts = 0;
+  n_pts       = 0;
+  n_tracked   = 0;
+  n_described = 0;
+  has_pyramid = false;
+  keypoints_time = 0;
+  detected_described = false;
+}
+
+// Constructor used by the pipeline: keypoints are found and described by later stages
+ProcessedImage::ProcessedImage(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose)
+{
+  convertImage(msg, pose);
 }
 
 //OF_mode = 1: use only optical flow
@@ -23,27 +39,97 @@ ProcessedImage::ProcessedImage()
 //OF_mode = 0: use OF and detection hybrid
 ProcessedImage::ProcessedImage(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose, ProcessedImage& prev, int OF_mode, bool& made_full_detection)
 {
+  process(msg, pose, prev, OF_mode, made_full_detection);
+}
+
+bool ProcessedImage::process(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose, ProcessedImage& prev, int OF_mode, bool& made_full_detection,
+                             const Rectifier* rectifier)
+{
+  if (!convertImage(msg, pose, rectifier))
+    return false;
+  findKeypoints(prev, OF_mode, made_full_detection);
+  describeKeypoints(prev);
+  return true;
+}
+
+void ProcessedImage::clear()
+{
+  cv_img.reset();
+  keypoints.clear();
+  prev_indices.clear();
+  track_ids.clear();
+  has_descriptor.clear();
+  n_pts       = 0;
+  n_tracked   = 0;
+  n_described = 0;
+  has_pyramid = false;
+  detected_described = false;
+}
+
+ProcessedImage::~ProcessedImage()
+{
+}
+
+bool ProcessedImage::convertImage(const sensor_msgs::Image& msg, const ucl_drone::Pose3D& pose, const Rectifier* rectifier)
+{
+  // keypoints of the image previously held are forgotten, buffers are kept
+  keypoints.clear();
+  prev_indices.clear();
+  track_ids.clear();
+  has_descriptor.clear();
+  n_pts       = 0;
+  n_tracked   = 0;
+  n_described = 0;
+  has_pyramid = false;
+  detected_described = false;
+
   this->pose = pose;
   this->pose.header.stamp = msg.header.stamp;
-  n_pts = 0;
 
-  // convert ROS image to OpenCV image
+  // convert ROS image to OpenCV image (without copy if it is already in the right encoding)
+  const std::string& encoding = mono ? sensor_msgs::image_encodings::MONO8 : sensor_msgs::image_encodings::BGR8;
+  cv_bridge::CvImageConstPtr src;
   try
   {
-    cv_img = cv_bridge::toCvCopy(msg, sensor_msgs::image_encodings::BGR8);
+    src = cv_bridge::toCvShare(msg, boost::shared_ptr<void const>(), encoding);
   }
   catch (cv_bridge::Exception& e)
   {
     ROS_ERROR("ucl_drone::imgproc::cv_bridge exception: %s", e.what());
-    return;
+    cv_img.reset();
+    return false;
   }
 
-  // Resize the image according to the parameters in the launch file
+  // Undistort and resize the image according to the parameters in the launch file (a single remap),
+  // in the buffer of the previous image when there is one
+  if (!cv_img)
+    cv_img.reset(new cv_bridge::CvImage());
+  cv_img->header   = msg.header;
+  cv_img->encoding = encoding;
+  if (rectifier && rectifier->enabled())
+  {
+    if (rectifier->apply(src->image, cv_img->image))
+      return true;
+    ROS_WARN_ONCE("ProcessedImage: image size (%dx%d) differs from the calibration, image not rectified",
+                  src->image.cols, src->image.rows);
+  }
   cv::Size size(Read::img_width(), Read::img_height());
-  cv::resize(cv_img->image, cv_img->image, size);
+  cv::resize(src->image, cv_img->image, size);
+  return true;
+}
 
-  // Convert opencv image to ROS Image message format
-  cv_img->toImageMsg(this->image);
+void ProcessedImage::findKeypoints(ProcessedImage& prev, int OF_mode, bool& made_full_detection)
+{
+  ros::WallTime start = ros::WallTime::now();
+  this->keypoints.clear();
+  this->prev_indices.clear();
+  this->track_ids.clear();
+  detected_described = false;
+  keypoints_time = 0;
+  if (!cv_img)
+    return;
+  // built now so that the next image and the target tracking can use it
+  buildPyramid();
 
   int min_x, max_x, min_y, max_y;
   int nrow = cv_img->image.rows;
@@ -53,25 +139,23 @@ ProcessedImage::ProcessedImage(const sensor_msgs::Image& msg, const ucl_drone::P
   int thresh_x = (int) ((double)ncol*pct_detect);
   int thresh_y = (int) ((double)nrow*pct_detect);
 
-  cv::Mat detected_descriptors;
   cv::Mat roi, mask;
   std::vector<cv::KeyPoint> detected_keypoints;
-  double thetime;
   bool hyb = false;
+  bool tracked;
   switch (OF_mode) {
     case 1:
-      trackKeypoints(this->descriptors,this->keypoints, prev, min_x, max_x, min_y, max_y);
-      if(min_x>max_x||min_y>max_y)
+      tracked = trackKeypoints(this->keypoints, this->prev_indices, prev, min_x, max_x, min_y, max_y);
+      if(!tracked||min_x>max_x||min_y>max_y)
       {
         ROS_WARN("No tracked keypoints?");
         this->keypoints.clear();
-        this->descriptors = cv::Mat();
-        detectKeypoints(this->descriptors, this->keypoints, true, mask);
+        this->prev_indices.clear();
+        detectKeypoints(this->keypoints, true, mask);
         made_full_detection = true;
       }
       else if(min_x<thresh_x||max_x>ncol-thresh_x||min_y<thresh_y||max_y>nrow-thresh_y)
       {
-        thetime = ros::Time::now().toSec();
         mask = cv::Mat::zeros(nrow,ncol,CV_8UC1);
         if(min_x<thresh_x)
         {
@@ -97,53 +181,148 @@ ProcessedImage::ProcessedImage(const sensor_msgs::Image& msg, const ucl_drone::P
           roi = cv::Scalar(1);
           hyb = true;
         }
-        detectKeypoints(detected_descriptors, detected_keypoints, false, mask);
-        keypoints.insert(keypoints.end(), detected_keypoints.begin(), detected_keypoints.end());
-        descriptors.push_back(detected_descriptors);
-        n_pts = this->keypoints.size();
+        detectKeypoints(detected_keypoints, false, mask);
       }
-      return;
+      break;
     case 0:
-      thetime = ros::Time::now().toSec();
-      trackKeypoints(this->descriptors,this->keypoints, prev, min_x, max_x, min_y, max_y);
-      if(min_x>max_x||min_y>max_y)
+      tracked = trackKeypoints(this->keypoints, this->prev_indices, prev, min_x, max_x, min_y, max_y);
+      if(!tracked||min_x>max_x||min_y>max_y)
       {
         ROS_WARN("No tracked keypoints?");
         this->keypoints.clear();
-        this->descriptors = cv::Mat();
-        detectKeypoints(this->descriptors, this->keypoints, true, mask);
-        n_pts = this->keypoints.size();
+        this->prev_indices.clear();
+        detectKeypoints(this->keypoints, true, mask);
         made_full_detection = true;
-        return;
+        break;
       }
       mask = cv::Mat::ones(nrow,ncol,CV_8UC1);
       roi = mask(cv::Rect(min_x,min_y,max_x-min_x,max_y-min_y));
       roi = cv::Scalar(0);
-      detectKeypoints(detected_descriptors, detected_keypoints, false, mask);
-      keypoints.insert(keypoints.end(), detected_keypoints.begin(), detected_keypoints.end());
-      descriptors.push_back(detected_descriptors);
-      n_pts = this->keypoints.size();
-      std::cout << "\033[1;36m[TIC TOC]: " << "Hybrid" << ": " << ros::Time::now().toSec() - thetime << "\033[0m\n";
-      ROS_INFO("Hybrid at %f",ros::Time::now().toSec());
-      return;
+      detectKeypoints(detected_keypoints, false, mask);
+      ROS_DEBUG("Hybrid at %f",ros::Time::now().toSec());
+      break;
     case -1:
-      detectKeypoints(this->descriptors, this->keypoints, true, mask);
+      detectKeypoints(this->keypoints, true, mask);
       made_full_detection = true;
-      n_pts = this->keypoints.size();
-      return;
+      break;
     default :
       ROS_INFO("Invalid OF_mode (%d)",OF_mode);
-      n_pts = 0;
   }
+
+  // tracked keypoints come first, detected keypoints are appended after them
+  n_tracked = this->prev_indices.size();
+  this->keypoints.insert(this->keypoints.end(), detected_keypoints.begin(), detected_keypoints.end());
+  this->prev_indices.resize(this->keypoints.size(), -1);
+  n_pts = this->keypoints.size();
+
+  // tracked keypoints keep the track of their keypoint in prev, the others start a new track
+  this->track_ids.assign(n_pts, 0);
+  int n_new = 0;
+  for (int i = 0; i < n_pts; i++)
+  {
+    int j = this->prev_indices[i];
+    if (j >= 0 && j < prev.track_ids.size())
+      this->track_ids[i] = prev.track_ids[j];
+    else
+      n_new++;
+  }
+  uint32_t new_id = newTrackIds(n_new);
+  for (int i = 0; i < n_pts; i++)
+  {
+    if (this->track_ids[i] == 0)
+      this->track_ids[i] = new_id++;
+  }
+  keypoints_time = (ros::WallTime::now() - start).toSec();
 }
 
-ProcessedImage::~ProcessedImage()
+uint32_t ProcessedImage::newTrackIds(int n)
+{
+  boost::mutex::scoped_lock lock(track_id_mutex);
+  if (next_track_id + (uint32_t)n < next_track_id) // wrap around, 0 is not a track id
+    next_track_id = 1;
+  uint32_t first = next_track_id;
+  next_track_id += n;
+  return first;
+}
+
+void ProcessedImage::describeKeypoints(const ProcessedImage& prev)
 {
+  TIC(describe);
+  ros::WallTime start = ros::WallTime::now();
+  // reuse the rows allocated for a previous image when possible
+  if (this->descriptors.data && this->descriptors.cols == FeatureTypes::descriptor_size()
+      && this->descriptors.type() == FeatureTypes::descriptor_type())
+    this->descriptors.resize(n_pts);
+  else
+    this->descriptors.create(n_pts, FeatureTypes::descriptor_size(), FeatureTypes::descriptor_type());
+  this->has_descriptor.assign(n_pts, 0);
+  n_described = 0;
+
+  // Tracked keypoints keep the descriptor computed in the previous image
+  for (int i = 0; i < n_tracked; i++)
+  {
+    int j = prev_indices[i];
+    if (j < (int)prev.has_descriptor.size() && prev.has_descriptor[j])
+    {
+      prev.descriptors.row(j).copyTo(this->descriptors.row(i));
+      this->has_descriptor[i] = 1;
+      n_described++;
+    }
+  }
+
+  if (n_pts == n_tracked)
+  {
+    keypoints_time += (ros::WallTime::now() - start).toSec();
+    return;
+  }
+
+  // Detected keypoints already described during their detection
+  if (detected_described && detected_descriptors.rows == n_pts - n_tracked)
+  {
+    detected_descriptors.copyTo(this->descriptors.rowRange(n_tracked, n_pts));
+    std::fill(this->has_descriptor.begin() + n_tracked, this->has_descriptor.end(), 1);
+    n_described += n_pts - n_tracked;
+    keypoints_time += (ros::WallTime::now() - start).toSec();
+    return;
+  }
+
+  // Detected keypoints are described by the extractor
+  TIC(extract);
+  // The extractor may remove keypoints it cannot describe (near the borders), reorder or adjust
+  // them (ORB, BRISK): each keypoint carries its index in class_id to find its descriptor back
+  std::vector<cv::KeyPoint> detected_keypoints(this->keypoints.begin() + n_tracked, this->keypoints.end());
+  for (unsigned k = 0; k < detected_keypoints.size(); k++)
+    detected_keypoints[k].class_id = n_tracked + k;
+  cv::Mat detected_descriptors;
+  FeatureTypes::compute(cv_img->image, detected_keypoints, detected_descriptors);
+  //TOC_DISPLAY(extract, "descriptor extrator");
+
+  for (unsigned k = 0; k < detected_keypoints.size(); k++)
+  {
+    int i = detected_keypoints[k].class_id;
+    if (i < n_tracked || i >= n_pts || this->has_descriptor[i])
+      continue;
+    detected_descriptors.row(k).copyTo(this->descriptors.row(i));
+    this->has_descriptor[i] = 1;
+    n_described++;
+  }
+  keypoints_time += (ros::WallTime::now() - start).toSec();
 }
 
+void ProcessedImage::buildPyramid()
+{
+  if (has_pyramid || !cv_img)
+    return;
+  if (cv_img->image.channels() == 3) // If the picture is in colours, convert it to grayscale
+    cv::cvtColor(cv_img->image, gray, CV_BGR2GRAY);
+  else
+    gray = cv_img->image;
+  cv::buildOpticalFlowPyramid(gray, of_pyramid, cv::Size(of_win_size, of_win_size), of_max_level);
+  has_pyramid = true;
+}
 
-bool ProcessedImage::trackKeypoints(cv::Mat& tracked_descriptors,
-std::vector<cv::KeyPoint>& tracked_keypoints, ProcessedImage& prev,
+bool ProcessedImage::trackKeypoints(std::vector<cv::KeyPoint>& tracked_keypoints,
+std::vector<int>& tracked_indices, ProcessedImage& prev,
 int& min_x, int& max_x, int& min_y, int& max_y)
 {
   TIC(track);
@@ -152,17 +331,9 @@ int& min_x, int& max_x, int& min_y, int& max_y)
   min_x = cv_img->image.cols + 1;  max_x = -1;
   min_y = cv_img->image.rows + 1;  max_y = -1;
   TIC(optical_flow);
-  cv::Mat prevgray, gray; // If the picture is in colours, convert it to grayscale
-  if (cv_img->image.channels() == 3)
-  {
-    cv::cvtColor(cv_img->image, gray, CV_RGB2GRAY);
-    cv::cvtColor(prev.cv_img->image, prevgray, CV_RGB2GRAY);
-  }
-  else
-  {
-    prevgray = prev.cv_img->image;
-    gray = cv_img->image;
-  }
+  // The pyramid of prev was normally built when prev was tracked
+  prev.buildPyramid();
+  this->buildPyramid();
 
   // Prepare structures to receive keypoints tracking results
   std::vector<uchar> vstatus(prev.n_pts);
@@ -171,7 +342,8 @@ int& min_x, int& max_x, int& min_y, int& max_y)
   std::vector<cv::Point2f> to_find = Points(prev.keypoints);
 
   // Perform keypoints tracking
-  cv::calcOpticalFlowPyrLK(prevgray, gray, to_find, found, vstatus, verror);
+  cv::calcOpticalFlowPyrLK(prev.of_pyramid, this->of_pyramid, to_find, found, vstatus, verror,
+                           cv::Size(of_win_size, of_win_size), of_max_level);
   // Copy all keypoints tracked with success
   double thresh = 12.0;
   for (int i = 0; i < prev.n_pts; i++)
@@ -186,6 +358,7 @@ int& min_x, int& max_x, int& min_y, int& max_y)
       if      (found[i].y<min_y) min_y = (int)floor(found[i].y);
       else if (found[i].y>max_y) max_y = (int)floor(found[i].y);
       tracked_keypoints.push_back(newKeyPoint);
+      tracked_indices.push_back(i);
     }
   }
   //TOC_DISPLAY(track, "tracking");
@@ -193,37 +366,38 @@ int& min_x, int& max_x, int& min_y, int& max_y)
   if (min_y < 0) min_y = 0;
   if (max_x >= cv_img->image.cols) max_x = cv_img->image.cols - 1;
   if (max_y >= cv_img->image.rows) max_y = cv_img->image.rows - 1;
-  if (tracked_keypoints.size() < prev.n_pts * 0.75 || tracked_keypoints.size() < 80)
+  if (tracked_keypoints.size() < prev.n_pts * min_tracked_ratio || (int)tracked_keypoints.size() < min_tracked)
   {
     tracked_keypoints.clear();
+    tracked_indices.clear();
     return false;
   }
-  int j = 0;
-  tracked_descriptors = cv::Mat::zeros(tracked_keypoints.size(), DESCRIPTOR_SIZE, CV_32F);
-  for (int i = 0; i < prev.n_pts; i++)
-  {
-    if (vstatus[i] && verror[i] < thresh)
-    {
-      for (unsigned k = 0; k < DESCRIPTOR_SIZE; k++)
-        tracked_descriptors.at<float>(j, k) = prev.descriptors.at<float>(i, k);
-      j++;
-    }
-  }
   return true;
 }
 
-void ProcessedImage::detectKeypoints(cv::Mat& detected_descriptors,
-std::vector<cv::KeyPoint>& detected_keypoints, bool full_detection, cv::Mat& mask)
+void ProcessedImage::detectKeypoints(std::vector<cv::KeyPoint>& detected_keypoints, bool full_detection, cv::Mat& mask)
 {
   TIC(detect);
 
-  if (full_detection) detector.detect(cv_img->image, detected_keypoints);
-  else                detector.detect(cv_img->image, detected_keypoints, mask);
+  detected_described = false;
+  if (GridDetector::enabled())
+  {
+    if (full_detection) GridDetector::detect(cv_img->image, detected_keypoints);
+    else                GridDetector::detect(cv_img->image, detected_keypoints, mask);
+  }
+  else if (FeatureTypes::fused())
+  {
+    // the descriptors are computed on the integral image / scale space of the detection
+    FeatureTypes::detectAndCompute(cv_img->image, full_detection ? cv::Mat() : mask, detected_keypoints,
+                                   detected_descriptors);
+    detected_described = true;
+  }
+  else
+  {
+    if (full_detection) FeatureTypes::detector().detect(cv_img->image, detected_keypoints);
+    else                FeatureTypes::detector().detect(cv_img->image, detected_keypoints, mask);
+  }
   //TOC_DISPLAY(detect, "detect detected_keypoints");
-  if (detected_keypoints.size() == 0) return;
-  TIC(extract);
-  extractor.compute(cv_img->image, detected_keypoints, detected_descriptors);
-  //TOC_DISPLAY(extract, "descriptor extrator");
 }
 
 void ProcessedImage::combineKeypoints(cv::Mat& tracked_descriptors,  std::vector<cv::KeyPoint>& tracked_keypoints,
@@ -256,99 +430,163 @@ void ProcessedImage::combineKeypoints(cv::Mat& tracked_descriptors,  std::vector
 // This function fill the message that will be sent by the computer vision node
 // [out] msg: the filled message
 // [in] target: the object to perform target detection
-void ProcessedImage::convertToMsg(ucl_drone::ProcessedImageMsg::Ptr& msg, Target target)
+void ProcessedImage::convertToMsg(ucl_drone::ProcessedImageMsg::Ptr& msg, TargetSet& targets, const ProcessedImage& prev)
 {
-  msg->pose = this->pose;
-  msg->image = this->image;
+  fillHeader(msg);
 
-  if (this->keypoints.size() == 0)
-    return;
+  // Only send keypoints which could be described
+  std::vector< cv::KeyPoint > described_keypoints;
+  cv::Mat described_descriptors;
+  std::vector< uint32_t > described_track_ids;
+  selectDescribed(described_keypoints, described_descriptors, described_track_ids);
+  const std::vector< cv::KeyPoint >& keypoints   = n_described < n_pts ? described_keypoints : this->keypoints;
+  const cv::Mat&                     descriptors = n_described < n_pts ? described_descriptors : this->descriptors;
+  const std::vector< uint32_t >&     track_ids   = n_described < n_pts ? described_track_ids : this->track_ids;
 
   TIC(target);
   // Prepare structures for target detection
-  std::vector< cv::DMatch > good_matches;
+  std::vector< TargetDetection > detections;
   std::vector< int > idxs_to_remove;
-  std::vector< cv::Point2f > target_coord;
-  // Perform target detection
-  bool target_is_detected =
-      target.detect(this->descriptors, this->keypoints, good_matches, idxs_to_remove, target_coord
-#ifdef DEBUG_PROJECTION
-                    ,
-                    this->pose
-#endif /* DEBUG_PROJECTION */
+  // Perform target detection (all targets at once), even without keypoints: tracked targets are
+  // followed (or lost) in every picture
+  // (targets detected in prev are tracked if both optical flow pyramids are available)
+  static const std::vector< cv::Mat > no_pyramid;
+  bool can_track = prev.has_pyramid && this->has_pyramid;
+  const std::vector< cv::Mat >& prev_pyramid = can_track ? prev.of_pyramid : no_pyramid;
+  const std::vector< cv::Mat >& pyramid      = can_track ? this->of_pyramid : no_pyramid;
+  bool target_is_detected = targets.detect(descriptors, keypoints, detections, idxs_to_remove,
+                                           prev_pyramid, pyramid);
+
+  msg->target_detected = target_is_detected;
+  targets.toMsg(detections, msg->targets);
+  if (target_is_detected) // the first target detected is also given in target_points
+    msg->target_points = msg->targets[0].target_points;
+
 #ifdef DEBUG_TARGET
-                    ,
-                    cv_img->image
+  if (target_is_detected && !detections[0].good_matches.empty())
+  {
+    cv::Mat img_matches;
+    targets.get_target(detections[0].target_id).draw(cv_img->image, keypoints, detections[0].good_matches, img_matches);
+    cv::imshow(OPENCV_WINDOW, img_matches);
+    cv::waitKey(3);
+  }
 #endif /* DEBUG_TARGET */
-                    );
 
-  if (target_is_detected)
+  if (keypoints.size() == 0)
+    return;
+
+  // the keypoints on the targets are not sent (to avoid mapping of moving target)
+  fillKeypoints(msg, keypoints, descriptors, track_ids, idxs_to_remove);
+  //TOC_DISPLAY(target, "detect and remove target");
+}
+
+void ProcessedImage::convertToMsg(ucl_drone::ProcessedImageMsg::Ptr& msg,
+                                  const std::vector< std::vector< cv::Point2f > >& target_areas)
+{
+  fillHeader(msg);
+  msg->targets_async = true;
+
+  std::vector< cv::KeyPoint > described_keypoints;
+  cv::Mat described_descriptors;
+  std::vector< uint32_t > described_track_ids;
+  selectDescribed(described_keypoints, described_descriptors, described_track_ids);
+  const std::vector< cv::KeyPoint >& keypoints   = n_described < n_pts ? described_keypoints : this->keypoints;
+  const cv::Mat&                     descriptors = n_described < n_pts ? described_descriptors : this->descriptors;
+  const std::vector< uint32_t >&     track_ids   = n_described < n_pts ? described_track_ids : this->track_ids;
+  if (keypoints.size() == 0)
+    return;
+
+  // the targets are not searched here: keypoints in the areas where they were last seen are not sent
+  std::vector< int > idxs_to_remove;
+  for (unsigned t = 0; t < target_areas.size(); t++)
+    Target::keypointsInside(target_areas[t], keypoints, idxs_to_remove);
+  std::sort(idxs_to_remove.begin(), idxs_to_remove.end());
+  idxs_to_remove.erase(std::unique(idxs_to_remove.begin(), idxs_to_remove.end()), idxs_to_remove.end());
+  fillKeypoints(msg, keypoints, descriptors, track_ids, idxs_to_remove);
+}
+
+void ProcessedImage::fillHeader(ucl_drone::ProcessedImageMsg::Ptr& msg) const
+{
+  msg->pose = this->pose;
+  if (cv_img)
   {
-    ROS_DEBUG("TARGET IS DETECTED");
-    msg->target_detected = true;
-    // Copy target center and corners position in the picture coordinates
-    msg->target_points.resize(5);
-    for (int i = 0; i < 5; i++)
-    {
-      msg->target_points[i].x = target_coord[i].x;
-      msg->target_points[i].y = target_coord[i].y;
-      msg->target_points[i].z = 0;
-    }
+    msg->header       = cv_img->header;
+    msg->image_width  = cv_img->image.cols;
+    msg->image_height = cv_img->image.rows;
   }
-  else
+  msg->descriptor_size = FeatureTypes::descriptor_size();
+  msg->descriptor_type = FeatureTypes::descriptor_type();
+}
+
+void ProcessedImage::selectDescribed(std::vector< cv::KeyPoint >& described_keypoints, cv::Mat& described_descriptors,
+                                     std::vector< uint32_t >& described_track_ids) const
+{
+  if (n_described == n_pts)
+    return;
+  for (int i = 0; i < n_pts; i++)
   {
-    msg->target_detected = false;
+    if (this->has_descriptor[i])
+    {
+      described_keypoints.push_back(this->keypoints[i]);
+      described_descriptors.push_back(this->descriptors.row(i));
+      described_track_ids.push_back(this->track_ids[i]);
+    }
   }
+}
 
-  if (this->keypoints.size() - idxs_to_remove.size() <= 0)
+void ProcessedImage::fillKeypoints(ucl_drone::ProcessedImageMsg::Ptr& msg, const std::vector< cv::KeyPoint >& keypoints,
+                                   const cv::Mat& descriptors, const std::vector< uint32_t >& track_ids,
+                                   const std::vector< int >& idxs_to_remove) const
+{
+  if (keypoints.size() <= idxs_to_remove.size())
   {
     // All keypoints are on the target
     return;
   }
 
-  // Remove keypoints on the target
-  msg->keypoints.resize(this->keypoints.size() - idxs_to_remove.size());
-  ROS_DEBUG("ProcessedImage::init msg->keypoints.size()=%lu", msg->keypoints.size());
-  int count = 0;
+  // Copy keypoints and descriptors in contiguous arrays, except the removed ones
+  // (idxs_to_remove is sorted in increasing order)
+  int n_kept = keypoints.size() - idxs_to_remove.size();
+  size_t descriptor_bytes = descriptors.cols * descriptors.elemSize();
+  msg->xy.resize(2 * n_kept);
+  msg->track_ids.resize(n_kept);
+  msg->descriptors.resize(n_kept * descriptor_bytes);
+  bool one_block = idxs_to_remove.empty() && descriptors.isContinuous();
+  if (one_block)
+    memcpy(msg->descriptors.data(), descriptors.data, n_kept * descriptor_bytes);
+  unsigned count = 0;
   int j = 0;
-  for (unsigned i = 0; i < this->keypoints.size() && j < msg->keypoints.size() &&
-                       (count < idxs_to_remove.size() || idxs_to_remove.size() == 0);
-       i++)
+  for (unsigned i = 0; i < keypoints.size(); i++)
   {
-    // exclude target points from message to send (to avoid mapping of moving target)
-    // very degueulasse: cv::KeyPoint =/= ucl_drone::KeyPoint, but they have some same fields with different names...
-    if (idxs_to_remove.size() == 0 || i != idxs_to_remove[count])
+    if (count < idxs_to_remove.size() && (int)i == idxs_to_remove[count])
     {
-      // Copy the current keypoint position
-      ucl_drone::KeyPoint keypoint;
-      geometry_msgs::Point point;
-      point.x = (double)this->keypoints[i].pt.x;
-      point.y = (double)this->keypoints[i].pt.y;
-
-      keypoint.point = point;
-
-      // Copy the current keypoint description
-      std::vector< float > descriptor;
-      descriptor.resize(DESCRIPTOR_SIZE);
-      for (unsigned k = 0; k < DESCRIPTOR_SIZE; k++)
-      {
-        descriptor[k] = this->descriptors.at< float >(i, k);
-      }
-      keypoint.descriptor = descriptor;
-
-      msg->keypoints[j] = keypoint;
-      j++;
-    }
-    if (idxs_to_remove.size() != 0 && i == idxs_to_remove[count])
-    {
-      // this way of doing is possible since idxs_to_remove are sorted in increasing order
-      if (count < idxs_to_remove.size() - 1)
-      {
-        count++;
-      }
+      count++;
+      continue;
     }
+    msg->xy[2 * j]     = keypoints[i].pt.x;
+    msg->xy[2 * j + 1] = keypoints[i].pt.y;
+    msg->track_ids[j]  = track_ids[i];
+    if (!one_block)
+      memcpy(&msg->descriptors[j * descriptor_bytes], descriptors.ptr(i), descriptor_bytes);
+    j++;
   }
-  //TOC_DISPLAY(target, "detect and remove target");
-  ROS_DEBUG("=========== POINT (%f;%f)", msg->keypoints[msg->keypoints.size() - 1].point.x,
-            msg->keypoints[msg->keypoints.size() - 1].point.y);
+}
+
+void ProcessedImage::toImageMsg(sensor_msgs::Image& image_msg) const
+{
+  if (cv_img)
+    cv_img->toImageMsg(image_msg);
+}
+
+bool ProcessedImage::toCompressedImageMsg(sensor_msgs::CompressedImage& image_msg, const std::string& format,
+                                          int quality) const
+{
+  if (!cv_img)
+    return false;
+  std::vector< int > params(2);
+  params[0] = format == "png" ? CV_IMWRITE_PNG_COMPRESSION : CV_IMWRITE_JPEG_QUALITY;
+  params[1] = quality;
+  image_msg.header = cv_img->header;
+  image_msg.format = format;
+  return cv::imencode(format == "png" ? ".png" : ".jpg", cv_img->image, image_msg.data, params);
 }
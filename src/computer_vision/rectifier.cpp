@@ -0,0 +1,73 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/rectifier.h>
+
+#include <camera_calibration_parsers/parse.h>
+#include <opencv2/calib3d/calib3d.hpp>
+#include <sensor_msgs/CameraInfo.h>
+
+Rectifier::Rectifier()
+{
+}
+
+bool Rectifier::init(const std::string& calibration_file, const cv::Size& size)
+{
+  map1.release();
+  map2.release();
+
+  std::string camera_name;
+  sensor_msgs::CameraInfo info;
+  if (!camera_calibration_parsers::readCalibration(calibration_file, camera_name, info))
+  {
+    ROS_ERROR("Rectifier: cannot read the camera calibration `%s`", calibration_file.c_str());
+    return false;
+  }
+  if (info.width == 0 || info.height == 0 || size.width <= 0 || size.height <= 0)
+  {
+    ROS_ERROR("Rectifier: invalid image size in `%s`", calibration_file.c_str());
+    return false;
+  }
+
+  cv::Mat K(3, 3, CV_64F, info.K.data());
+  cv::Mat R(3, 3, CV_64F, info.R.data());
+  cv::Mat P(3, 4, CV_64F, info.P.data());
+  cv::Mat D; // no distortion if empty
+  if (!info.D.empty())
+    D = cv::Mat(info.D, true).reshape(1, 1);
+
+  // camera matrix of the rectified images, rescaled from the calibrated size to the processed size
+  cv::Mat camera_matrix = P.colRange(0, 3).clone();
+  camera_matrix.row(0) *= (double)size.width / info.width;
+  camera_matrix.row(1) *= (double)size.height / info.height;
+
+  raw_size = cv::Size(info.width, info.height);
+  this->size = size;
+  cv::initUndistortRectifyMap(K, D, R, camera_matrix, size, CV_16SC2, map1, map2);
+
+  ROS_INFO("Rectifier: %s (%dx%d) rectified to %dx%d, fx=%.1f fy=%.1f cx=%.1f cy=%.1f",
+           camera_name.c_str(), raw_size.width, raw_size.height, size.width, size.height,
+           camera_matrix.at< double >(0, 0), camera_matrix.at< double >(1, 1),
+           camera_matrix.at< double >(0, 2), camera_matrix.at< double >(1, 2));
+  return true;
+}
+
+bool Rectifier::enabled() const
+{
+  return !map1.empty();
+}
+
+bool Rectifier::apply(const cv::Mat& raw, cv::Mat& image) const
+{
+  if (!enabled() || raw.size() != raw_size)
+    return false;
+  cv::remap(raw, image, map1, map2, cv::INTER_LINEAR);
+  return true;
+}
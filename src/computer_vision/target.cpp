@@ -12,14 +12,34 @@
 
 #include <ucl_drone/computer_vision/target.h>
 
+#include <cstdio>
+
 //! Absolute path to the package
 static const std::string PKG_DIR = ros::package::getPath("ucl_drone");
 
-#if EXTRACTOR_TYPE == TYPE_ORB
-Target::Target() : matcher(new cv::flann::LshIndexParams(20, 10, 2))
-#else
+std::string contentHash(const cv::Mat& data)
+{
+  uint64_t hash = 14695981039346656037ULL;
+  size_t row_size = data.cols * data.elemSize();
+  for (int i = 0; i < data.rows; i++)
+  {
+    const uchar* row = data.ptr< uchar >(i);
+    for (size_t k = 0; k < row_size; k++)
+      hash = (hash ^ row[k]) * 1099511628211ULL;
+  }
+  char hex[17];
+  snprintf(hex, sizeof(hex), "%016llx", (unsigned long long)hash);
+  return hex;
+}
+
+//! Hash of the parameters of the features (see FeatureTypes::parameters)
+static std::string parametersHash()
+{
+  std::string parameters = FeatureTypes::parameters();
+  return contentHash(cv::Mat(1, parameters.size(), CV_8U, (void*)parameters.data()));
+}
+
 Target::Target()
-#endif /* EXTRACTOR_TYPE == TYPE_ORB */
 {
 }
 
@@ -41,6 +61,7 @@ bool Target::init(const std::string relative_path)
   };
 
   image = target_img;
+  name  = relative_path.substr(relative_path.find_last_of('/') + 1);
 
   // Determine position of corners and center on the image picture
   // This is used to draw green rectangle in the viewer and to estimate target world coordinates
@@ -53,17 +74,21 @@ bool Target::init(const std::string relative_path)
 
   ROS_DEBUG("TARGET IMAGE DIMENSIONS: %d,%d", image.cols, image.rows);
 
-  detector.detect(image, keypoints);
-  extractor.compute(image, keypoints, descriptors);
-
-  /*
-  // We didn't know the exact effect of these lines, maybe it will improve matching performances
-  // Read opencv API for more informations
-  std::vector<cv::Mat> descriptor_vector;
-  descriptor_vector.push_back(descriptors);
-  matcher.add(descriptor_vector);
-  matcher.train();
-  */
+  // Features are computed once for a given picture, detector and extractor
+  // (fused descriptors are computed on the scale space of the detector: cached apart)
+  std::string cache = str + "." + FeatureTypes::detector_name() + "_" + FeatureTypes::extractor_name()
+                      + (FeatureTypes::fused() ? "_fused" : "");
+  if (!loadFeatures(cache))
+  {
+    if (FeatureTypes::fused())
+      FeatureTypes::detectAndCompute(image, cv::Mat(), keypoints, descriptors);
+    else
+    {
+      FeatureTypes::detector().detect(image, keypoints);
+      FeatureTypes::compute(image, keypoints, descriptors);
+    }
+    saveFeatures(cache);
+  }
 
   ROS_DEBUG("DESCRIPTORS DIMENSIONS: %d,%d", descriptors.cols, descriptors.rows);
   ROS_DEBUG("end Target::init");
@@ -71,162 +96,109 @@ bool Target::init(const std::string relative_path)
   return true;
 }
 
-// This function is called when target detection has to be performed on a picture
-bool Target::detect(cv::Mat cam_descriptors, std::vector< cv::KeyPoint >& cam_keypoints,
-                    std::vector< cv::DMatch >& good_matches, std::vector< int >& idxs_to_remove,
-                    std::vector< cv::Point2f >& target_coord
-#ifdef DEBUG_PROJECTION
-                    ,
-                    ucl_drone::Pose3D pose
-#endif
-#ifdef DEBUG_TARGET
-                    ,
-                    cv::Mat& image_cam
-#endif
-                    )
+bool Target::loadFeatures(const std::string& path)
 {
-  ROS_DEBUG("begin Target::detect");
-  // step 3: matching descriptors
+  cv::FileStorage fs(path + ".features.yml", cv::FileStorage::READ);
+  if (!fs.isOpened())
+    return false;
 
-  if (cam_descriptors.rows == 0)
+  // the cache is outdated if the picture or the features (or their parameters) changed
+  std::string detector_name, extractor_name, parameters_hash, image_hash;
+  int rows, cols;
+  fs["detector"] >> detector_name;
+  fs["extractor"] >> extractor_name;
+  fs["parameters_hash"] >> parameters_hash;
+  fs["image_rows"] >> rows;
+  fs["image_cols"] >> cols;
+  fs["image_hash"] >> image_hash;
+  if (detector_name != FeatureTypes::detector_name() || extractor_name != FeatureTypes::extractor_name()
+      || parameters_hash != parametersHash() || rows != image.rows || cols != image.cols
+      || image_hash != contentHash(image))
   {
+    ROS_INFO("Target features cache %s is outdated", path.c_str());
     return false;
   }
-
-  bool target_detected = false;
-
-  std::vector< cv::DMatch > matches;
-  matcher.match(descriptors, cam_descriptors, matches);
-
-  // step 5: Draw only "good" matches
-  for (int i = 0; i < descriptors.rows; i++)
+  cv::read(fs["keypoints"], keypoints);
+  fs["descriptors"] >> descriptors;
+  if (descriptors.rows != (int)keypoints.size() || descriptors.rows < 2
+      || descriptors.type() != FeatureTypes::descriptor_type()
+      || descriptors.cols != FeatureTypes::descriptor_size())
   {
-    if (matches[i].distance < DIST_THRESHOLD * 0.75)  // 1.2)
-    {
-      good_matches.push_back(matches[i]);
-    }
+    ROS_INFO("Target features cache %s is outdated", path.c_str());
+    return false;
   }
-  // std::vector< std::vector< cv::DMatch > > matches2;
-  // matcher.radiusMatch(descriptors, cam_descriptors, matches2, DIST_THRESHOLD * 1.1);
-  // for (int i = 0; i < matches2.size(); i++)
-  // {
-  //   for (int k = 0; k < matches2[i].size(); k++)
-  //   {
-  //     idxs_to_remove.push_back(matches2[i][k].trainIdx);
-  //   }
-  // }
-
-  ROS_DEBUG("Target::detect matches:%lu", good_matches.size());
-  if (good_matches.size() > this->descriptors.rows / 6.0 && good_matches.size() > 8)
-  {
-    target_detected = true;
-    this->position(cam_keypoints, good_matches, target_coord);
-
-    std::vector< cv::Point2f >::const_iterator first = target_coord.begin();
-    std::vector< cv::Point2f >::const_iterator last = target_coord.begin() + 4;
-    std::vector< cv::Point2f > contour(first, last);
+  ROS_INFO("Target features loaded from %s", path.c_str());
+  return true;
+}
 
-    for (unsigned i = 0; i < cam_keypoints.size(); i++)
-    {
-      double result = cv::pointPolygonTest(contour, cam_keypoints[i].pt, false);
-      if (result >= 0)
-      {
-        idxs_to_remove.push_back(i);
-      }
-    }
+void Target::saveFeatures(const std::string& path)
+{
+  if (descriptors.rows < 2) // a ratio test needs two neighbours
+  {
+    ROS_WARN("Target: not enough keypoints (%d) in %s", descriptors.rows, name.c_str());
+    return;
   }
 
-  std::sort(idxs_to_remove.begin(), idxs_to_remove.end());  //, customLess);
-
-  // remove duplicates
-  int k = 1;
-  for (int i = 1; i < idxs_to_remove.size(); i++)
+  cv::FileStorage fs(path + ".features.yml", cv::FileStorage::WRITE);
+  if (!fs.isOpened())
   {
-    if (idxs_to_remove[i] != idxs_to_remove[i - 1])
-    {
-      idxs_to_remove[k] = idxs_to_remove[i];
-      k++;
-    }
+    ROS_WARN("Target: cannot write features cache %s", path.c_str());
+    return;
   }
-  idxs_to_remove.resize(k);
-
-#ifdef DEBUG_TARGET
-  cv::Mat img_matches;
-  cv::drawMatches(image, keypoints, image_cam, cam_keypoints, good_matches, img_matches,
-                  cv::Scalar::all(-1), cv::Scalar::all(-1), std::vector< char >(),
-                  cv::DrawMatchesFlags::NOT_DRAW_SINGLE_POINTS);
-  cv::imshow(OPENCV_WINDOW, img_matches);
-  cv::waitKey(3);
-#endif /*DEBUG_TARGET*/
+  fs << "detector" << FeatureTypes::detector_name();
+  fs << "extractor" << FeatureTypes::extractor_name();
+  fs << "parameters_hash" << parametersHash();
+  fs << "image_rows" << image.rows;
+  fs << "image_cols" << image.cols;
+  fs << "image_hash" << contentHash(image);
+  cv::write(fs, "keypoints", keypoints);
+  fs << "descriptors" << descriptors;
+  fs.release();
+  ROS_INFO("Target features saved to %s", path.c_str());
+}
 
-  if (!target_detected)
+bool Target::locate(const std::vector< cv::KeyPoint >& cam_keypoints,
+                    const std::vector< cv::DMatch >& good_matches, std::vector< int >& idxs_to_remove,
+                    std::vector< cv::Point2f >& target_coord, std::vector< uchar >* inliers) const
+{
+  if (good_matches.size() <= this->descriptors.rows / 6.0 || good_matches.size() <= 8)
     return false;
 
-#ifdef DEBUG_PROJECTION
-
-  ROS_INFO("DEBUG_PROJECTION");
-  std::vector< cv::Point2f > obj;
-  std::vector< cv::Point2f > scene;
+  if (!this->position(cam_keypoints, good_matches, target_coord, inliers))
+    return false;
 
-  for (int i = 0; i < good_matches.size(); i++)
-  {
-    // Get the keypoints from the good matches
-    obj.push_back(keypoints[good_matches[i].queryIdx].pt);
-    scene.push_back(cam_keypoints[good_matches[i].trainIdx].pt);
-  }
+  keypointsInside(target_coord, cam_keypoints, idxs_to_remove);
+  return true;
+}
 
-  std::vector< uchar > mask;
-  cv::Mat H =
-      cv::findHomography(obj, scene, CV_RANSAC, 2, mask);  // arg#4: ransacReprojThreshold [pixel]
+void Target::keypointsInside(const std::vector< cv::Point2f >& target_coord,
+                             const std::vector< cv::KeyPoint >& cam_keypoints, std::vector< int >& idxs)
+{
+  std::vector< cv::Point2f >::const_iterator first = target_coord.begin();
+  std::vector< cv::Point2f >::const_iterator last = target_coord.begin() + 4;
+  std::vector< cv::Point2f > contour(first, last);
+  cv::Rect box = cv::boundingRect(contour);  // cheap test before the polygon one
 
-  std::string rel_error = "\nrelative_error = [";
-  std::string abs_error = "\nabsolute_error = [";
-  for (int i = 0; i < good_matches.size(); i++)
+  for (unsigned i = 0; i < cam_keypoints.size(); i++)
   {
-    for (int j = i + 1; j < good_matches.size(); j++)
+    if (!box.contains(cam_keypoints[i].pt))
+      continue;
+    double result = cv::pointPolygonTest(contour, cam_keypoints[i].pt, false);
+    if (result >= 0)
     {
-      if (mask[i] == 1 && mask[j] == 1)
-      {
-        cv::Point2f target_point1 = this->keypoints[good_matches[i].queryIdx].pt;
-        cv::Point2f target_point2 = this->keypoints[good_matches[j].queryIdx].pt;
-        double dist1 = cv::norm(target_point1 - target_point2) * 0.274 / 240.0;  // 0.205 / 135.0;
-
-        if (dist1 > 0.1)
-        {
-          std::vector< cv::Point2f > camera_points(2);
-          camera_points[0] = cam_keypoints[good_matches[i].trainIdx].pt;
-          camera_points[1] = cam_keypoints[good_matches[j].trainIdx].pt;
-          std::vector< cv::Point3f > map_points(2);
-          projection_2D(camera_points, pose, map_points, true);
-          double dist2 = cv::norm(map_points[0] - map_points[1]);
-
-          //   if (dist2 > 0.001)  // if two super-imposed identical descriptors in map
-          //   {
-          double relative_error = (dist2 - dist1) / dist1;
-
-          double absolute_error = (dist2 - dist1);
-
-          rel_error += to_string(relative_error) + ", ";
-          abs_error += to_string(absolute_error) + ", ";
-          //   }
-        }
-      }
+      idxs.push_back(i);
     }
   }
-  rel_error += "];\n\n";
-  abs_error += "];\n\n";
-
-  printf("%s", rel_error.c_str());
-  printf("%s", abs_error.c_str());
-
-#endif /*DEBUG_PROJECTION*/
+}
 
-  ROS_DEBUG("end Target::detect");
-  return true;
+void Target::project(const cv::Mat& H, std::vector< cv::Point2f >& coord) const
+{
+  coord.resize(5);
+  cv::perspectiveTransform(centerAndCorners, coord, H);
 }
 
 void Target::draw(cv::Mat cam_img, std::vector< cv::KeyPoint > cam_keypoints,
-                  std::vector< cv::DMatch > good_matches, cv::Mat& img_matches)
+                  std::vector< cv::DMatch > good_matches, cv::Mat& img_matches) const
 {
   cv::drawMatches(image, keypoints, cam_img, cam_keypoints, good_matches, img_matches,
                   cv::Scalar::all(-1), cv::Scalar::all(-1), std::vector< char >(),
@@ -268,8 +240,9 @@ void Target::draw(cv::Mat cam_img, std::vector< cv::KeyPoint > cam_keypoints,
   ROS_DEBUG("end Target::draw");
 }
 
-void Target::position(std::vector< cv::KeyPoint > cam_keypoints,
-                      std::vector< cv::DMatch > good_matches, std::vector< cv::Point2f >& coord)
+bool Target::position(const std::vector< cv::KeyPoint >& cam_keypoints,
+                      const std::vector< cv::DMatch >& good_matches, std::vector< cv::Point2f >& coord,
+                      std::vector< uchar >* inliers) const
 {
   // step 6: Localize the object
   std::vector< cv::Point2f > obj;
@@ -282,14 +255,19 @@ void Target::position(std::vector< cv::KeyPoint > cam_keypoints,
     scene.push_back(cam_keypoints[good_matches[i].trainIdx].pt);
   }
 
-  cv::Mat H = cv::findHomography(obj, scene, CV_RANSAC, 2);
+  cv::Mat H;
+  if (inliers)
+    H = cv::findHomography(obj, scene, CV_RANSAC, 2, *inliers);
+  else
+    H = cv::findHomography(obj, scene, CV_RANSAC, 2);
+  if (H.empty())
+    return false;
 
   // step 7: Get the corners from the target
-  coord.resize(5);
-
-  cv::perspectiveTransform(centerAndCorners, coord, H);
+  project(H, coord);
 
   ROS_DEBUG("end Target::position");
+  return true;
 }
 
 bool customLess(cv::DMatch a, cv::DMatch b)
@@ -0,0 +1,290 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/computer_vision/target_set.h>
+
+//! Path of the combined index of the targets (without extension), for the current features
+static std::string indexPath()
+{
+  return ros::package::getPath("ucl_drone") + "/target/target_set." + FeatureTypes::detector_name() + "_"
+         + FeatureTypes::extractor_name() + (FeatureTypes::fused() ? "_fused" : "");
+}
+
+TargetSet::TargetSet()
+{
+}
+
+bool TargetSet::loadIndex(const std::string& path)
+{
+  cv::FileStorage fs(path + ".index.yml", cv::FileStorage::READ);
+  if (!fs.isOpened())
+    return false;
+  std::string hash;
+  fs["descriptors_hash"] >> hash;
+  if (hash != contentHash(indexed_descriptors))
+  {
+    ROS_INFO("TargetSet: index %s is outdated", path.c_str());
+    return false;
+  }
+  index = new cv::flann::Index();
+  if (!index->load(indexed_descriptors, path + ".flann"))
+  {
+    index.release();
+    return false;
+  }
+  ROS_INFO("TargetSet: index loaded from %s", path.c_str());
+  return true;
+}
+
+void TargetSet::saveIndex(const std::string& path) const
+{
+  cv::FileStorage fs(path + ".index.yml", cv::FileStorage::WRITE);
+  if (!fs.isOpened())
+  {
+    ROS_WARN("TargetSet: cannot write index %s", path.c_str());
+    return;
+  }
+  fs << "descriptors_hash" << contentHash(indexed_descriptors);
+  fs.release();
+  index->save(path + ".flann");
+  ROS_INFO("TargetSet: index saved to %s", path.c_str());
+}
+
+bool TargetSet::init(const std::vector< std::string >& relative_paths)
+{
+  targets.clear();
+  descriptors.release();
+  row_target.clear();
+  row_keypoint.clear();
+  tracks.clear();
+
+  for (unsigned i = 0; i < relative_paths.size(); i++)
+  {
+    Target target;
+    if (!target.init(relative_paths[i]) || target.get_descriptors().rows == 0)
+    {
+      ROS_WARN("TargetSet: target %s not loaded", relative_paths[i].c_str());
+      continue;
+    }
+    int id = targets.size();
+    targets.push_back(target);
+    descriptors.push_back(target.get_descriptors());
+    for (int k = 0; k < target.get_descriptors().rows; k++)
+    {
+      row_target.push_back(id);
+      row_keypoint.push_back(k);
+    }
+  }
+
+  if (descriptors.rows < 2)  // a ratio test needs two neighbours
+  {
+    ROS_ERROR("TargetSet: no target loaded");
+    return false;
+  }
+  tracks.resize(targets.size());
+  for (unsigned t = 0; t < tracks.size(); t++)
+    tracks[t].active = false;
+
+  // the index is not needed when descriptors are matched by brute force; otherwise it is built
+  // once for a given set of targets and features, and saved next to the pictures
+  if (FeatureTypes::brute_force())
+  {
+    index.release();
+    indexed_descriptors.release();
+  }
+  else
+  {
+    indexed_descriptors = FeatureTypes::indexable(descriptors);
+    std::string path    = indexPath();
+    if (!loadIndex(path))
+    {
+      index = FeatureTypes::createIndex(indexed_descriptors);
+      saveIndex(path);
+    }
+    index_mutex.reset(new boost::mutex);
+  }
+
+  ROS_INFO("TargetSet: %lu targets, %d descriptors", targets.size(), descriptors.rows);
+  return true;
+}
+
+bool TargetSet::detect(const cv::Mat& cam_descriptors, const std::vector< cv::KeyPoint >& cam_keypoints,
+                       std::vector< TargetDetection >& detections, std::vector< int >& idxs_to_remove,
+                       const std::vector< cv::Mat >& prev_pyramid, const std::vector< cv::Mat >& pyramid)
+{
+  if (descriptors.rows < 2 || (!FeatureTypes::brute_force() && index.empty()))
+    return false;
+
+  // step 0: follow the targets detected in the previous picture
+  bool can_track = !prev_pyramid.empty() && !pyramid.empty();
+  bool all_tracked = true;
+  std::vector< bool > tracked(targets.size(), false);
+  for (unsigned t = 0; t < targets.size(); t++)
+  {
+    if (!tracks[t].active)
+    {
+      all_tracked = false;
+      continue;
+    }
+    TargetDetection detection;
+    if (can_track && track(t, prev_pyramid, pyramid, cam_keypoints, detection, idxs_to_remove))
+    {
+      tracked[t] = true;
+      detections.push_back(detection);
+    }
+    else
+    {
+      ROS_DEBUG("TargetSet: target %d lost", t);
+      tracks[t].active = false;
+      all_tracked = false;
+    }
+  }
+
+  if (all_tracked || cam_descriptors.rows == 0)
+  {
+    std::sort(idxs_to_remove.begin(), idxs_to_remove.end());
+    idxs_to_remove.erase(std::unique(idxs_to_remove.begin(), idxs_to_remove.end()), idxs_to_remove.end());
+    return !detections.empty();
+  }
+
+  // step 1: one search for all targets: two nearest target descriptors of each camera descriptor
+  std::vector< std::vector< cv::DMatch > > knn_matches;
+  if (FeatureTypes::brute_force())
+    bruteForceKnnMatch(cam_descriptors, descriptors, knn_matches, 2, FeatureTypes::norm_type());
+  else
+  {
+    boost::mutex::scoped_lock lock(*index_mutex);
+    flannKnnMatch(*index, cam_descriptors, knn_matches, 2, FeatureTypes::norm_type());
+  }
+
+  // step 2: keep distinctive matches (ratio test against all targets), close enough, and the best
+  // one for each target keypoint, grouped by target
+  std::vector< cv::DMatch > matches;
+  MatchOptions options(TARGET_MATCH_DIST * FeatureTypes::dist_threshold(), TARGET_MATCH_RATIO);
+  filterKnnMatches(knn_matches, descriptors.rows, options, matches);
+  std::vector< std::vector< cv::DMatch > > good_matches(targets.size());
+  for (unsigned k = 0; k < matches.size(); k++)
+  {
+    int row = matches[k].trainIdx;
+    good_matches[row_target[row]].push_back(cv::DMatch(row_keypoint[row], matches[k].queryIdx, matches[k].distance));
+  }
+
+  // step 3: locate each target (not tracked) with its own matches, and start tracking it
+  for (unsigned t = 0; t < targets.size(); t++)
+  {
+    if (tracked[t])
+      continue;
+    TargetDetection detection;
+    std::vector< uchar > inliers;
+    if (targets[t].locate(cam_keypoints, good_matches[t], idxs_to_remove, detection.target_coord, &inliers))
+    {
+      startTrack(t, cam_keypoints, good_matches[t], inliers);
+      detection.target_id = t;
+      detection.good_matches.swap(good_matches[t]);
+      detections.push_back(detection);
+    }
+  }
+
+  std::sort(idxs_to_remove.begin(), idxs_to_remove.end());
+  idxs_to_remove.erase(std::unique(idxs_to_remove.begin(), idxs_to_remove.end()), idxs_to_remove.end());
+
+  ROS_DEBUG("TargetSet::detect %lu targets detected", detections.size());
+  return !detections.empty();
+}
+
+void TargetSet::startTrack(int target_id, const std::vector< cv::KeyPoint >& cam_keypoints,
+                           const std::vector< cv::DMatch >& good_matches, const std::vector< uchar >& inliers)
+{
+  TargetTrack& track = tracks[target_id];
+  const std::vector< cv::KeyPoint >& target_keypoints = targets[target_id].get_keypoints();
+  track.target_points.clear();
+  track.image_points.clear();
+  for (unsigned i = 0; i < good_matches.size() && i < inliers.size(); i++)
+  {
+    if (inliers[i])
+    {
+      track.target_points.push_back(target_keypoints[good_matches[i].queryIdx].pt);
+      track.image_points.push_back(cam_keypoints[good_matches[i].trainIdx].pt);
+    }
+  }
+  track.initial_size = track.target_points.size();
+  track.active = track.initial_size >= TARGET_TRACK_MIN_POINTS;
+}
+
+bool TargetSet::track(int target_id, const std::vector< cv::Mat >& prev_pyramid,
+                      const std::vector< cv::Mat >& pyramid, const std::vector< cv::KeyPoint >& cam_keypoints,
+                      TargetDetection& detection, std::vector< int >& idxs_to_remove)
+{
+  TargetTrack& track = tracks[target_id];
+
+  // follow the inliers of the last homography
+  std::vector< cv::Point2f > found;
+  std::vector< uchar > status;
+  std::vector< float > error;
+  cv::calcOpticalFlowPyrLK(prev_pyramid, pyramid, track.image_points, found, status, error,
+                           cv::Size(TARGET_TRACK_WIN_SIZE, TARGET_TRACK_WIN_SIZE), 3);
+
+  std::vector< cv::Point2f > obj, scene;
+  for (unsigned i = 0; i < found.size(); i++)
+  {
+    if (status[i])
+    {
+      obj.push_back(track.target_points[i]);
+      scene.push_back(found[i]);
+    }
+  }
+  if (obj.size() < TARGET_TRACK_MIN_POINTS || obj.size() < TARGET_TRACK_MIN_KEPT * track.initial_size)
+    return false;
+
+  // the homography is estimated from the tracked points only
+  std::vector< uchar > inliers;
+  cv::Mat H = cv::findHomography(obj, scene, CV_RANSAC, 2, inliers);
+  if (H.empty())
+    return false;
+
+  track.target_points.clear();
+  track.image_points.clear();
+  for (unsigned i = 0; i < obj.size(); i++)
+  {
+    if (inliers[i])
+    {
+      track.target_points.push_back(obj[i]);
+      track.image_points.push_back(scene[i]);
+    }
+  }
+  if (track.target_points.size() < TARGET_TRACK_MIN_POINTS
+      || track.target_points.size() < TARGET_TRACK_MIN_INLIERS * obj.size())
+    return false;
+
+  detection.target_id = target_id;
+  targets[target_id].project(H, detection.target_coord);
+  Target::keypointsInside(detection.target_coord, cam_keypoints, idxs_to_remove);
+  return true;
+}
+
+void TargetSet::toMsg(const std::vector< TargetDetection >& detections,
+                      std::vector< ucl_drone::TargetObservation >& observations) const
+{
+  observations.resize(detections.size());
+  for (unsigned k = 0; k < detections.size(); k++)
+  {
+    ROS_DEBUG("TARGET %d IS DETECTED", detections[k].target_id);
+    observations[k].target_id = detections[k].target_id;
+    observations[k].name      = targets[detections[k].target_id].get_name();
+    // Copy target center and corners position in the picture coordinates
+    observations[k].target_points.resize(5);
+    for (int i = 0; i < 5; i++)
+    {
+      observations[k].target_points[i].x = detections[k].target_coord[i].x;
+      observations[k].target_points[i].y = detections[k].target_coord[i].y;
+      observations[k].target_points[i].z = 0;
+    }
+  }
+}
@@ -0,0 +1,84 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, refer
+ *  to the corresponding header file.
+ *
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/image_payload.h>
+
+ImagePayload::ImagePayload(const std::string& processed_image_channel)
+  : image_channel(processed_image_channel + "/image")
+{
+}
+
+ImagePayload::~ImagePayload()
+{
+}
+
+void ImagePayload::imageCb(const sensor_msgs::Image::ConstPtr& msg)
+{
+  images.push_back(msg);
+  if (images.size() > max_images)
+    images.pop_front();
+}
+
+bool ImagePayload::getImage(const ucl_drone::ProcessedImageMsg& msg, cv_bridge::CvImagePtr& image,
+                            const std::string& encoding)
+{
+  try
+  {
+    switch (msg.image_payload)
+    {
+      case ucl_drone::ProcessedImageMsg::IMAGE_RAW:
+        image = cv_bridge::toCvCopy(msg.image, encoding);
+        return true;
+
+      case ucl_drone::ProcessedImageMsg::IMAGE_COMPRESSED:
+      {
+        int flags = encoding == sensor_msgs::image_encodings::BGR8    ? CV_LOAD_IMAGE_COLOR
+                    : encoding == sensor_msgs::image_encodings::MONO8 ? CV_LOAD_IMAGE_GRAYSCALE
+                                                                      : CV_LOAD_IMAGE_UNCHANGED;
+        cv::Mat decoded = cv::imdecode(msg.compressed_image.data, flags);
+        if (!decoded.data || (!encoding.empty() && flags == CV_LOAD_IMAGE_UNCHANGED))
+        {
+          ROS_ERROR("ImagePayload: cannot decode the %s image in %s", msg.compressed_image.format.c_str(),
+                    encoding.c_str());
+          return false;
+        }
+        image.reset(new cv_bridge::CvImage(msg.header, decoded.channels() == 1 ? sensor_msgs::image_encodings::MONO8
+                                                                               : sensor_msgs::image_encodings::BGR8,
+                                           decoded));
+        return true;
+      }
+
+      case ucl_drone::ProcessedImageMsg::IMAGE_REFERENCE:
+        // the computer vision node publishes the images only if someone listens
+        if (!image_sub)
+        {
+          ROS_INFO("ImagePayload: subscribing to %s", image_channel.c_str());
+          image_sub = nh.subscribe(image_channel, max_images, &ImagePayload::imageCb, this);
+        }
+        for (unsigned i = images.size(); i-- > 0;)
+        {
+          if (images[i]->header.stamp == msg.header.stamp)
+          {
+            image = cv_bridge::toCvCopy(images[i], encoding);
+            return true;
+          }
+        }
+        return false;
+
+      default:
+        return false;
+    }
+  }
+  catch (cv_bridge::Exception& e)
+  {
+    ROS_ERROR("ucl_drone::ImagePayload::cv_bridge exception: %s", e.what());
+    return false;
+  }
+}
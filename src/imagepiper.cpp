@@ -16,14 +16,14 @@
 #include "ucl_drone/imagepiper.h"
 
 // Constructor
-Piper::Piper()
+Piper::Piper() : image_payload(nh.resolveName("processed_image"))
 {
   // Subscribers
-  proc_im_channel = nh.resolveName("/processed_image");
+  proc_im_channel = nh.resolveName("processed_image");
   proc_im_sub = nh.subscribe(proc_im_channel, 10, &Piper::processedImageCb, this);
 
   // Publishers
-  im_channel = nh.resolveName("/ardrone/front/camera/image_raw");
+  im_channel = nh.resolveName("ardrone/front/camera/image_raw");
   im_pub = nh.advertise<sensor_msgs::Image>(im_channel, 1);
 }
 
@@ -39,7 +39,12 @@ void Piper::publish_image(sensor_msgs::Image& img)
 
 void Piper::processedImageCb(const ucl_drone::ProcessedImageMsg::ConstPtr processed_image_in)
 {
-  sensor_msgs::Image img = processed_image_in->image;
+  cv_bridge::CvImagePtr cv_img;
+  // republished as received (MONO8 if the computer vision node is in mono)
+  if (!image_payload.getImage(*processed_image_in, cv_img, ""))
+    return;
+  sensor_msgs::Image img;
+  cv_img->toImageMsg(img);
   publish_image(img);
 }
 
@@ -10,7 +10,7 @@
 
 #include <ucl_drone/map/mapping_node.h>
 
-Frame::Frame()
+Frame::Frame() : image_width(0), image_height(0)
 {
 }
 
@@ -18,20 +18,26 @@ Frame::Frame(ucl_drone::ProcessedImageMsg::ConstPtr msg)
 {
   this->pose = msg->pose;
 
-  // convert msg to opencv format
-  this->img_points.resize(msg->keypoints.size());
-  this->descriptors = cv::Mat_<float>(msg->keypoints.size(), DESCRIPTOR_SIZE);
-  this->image = msg->image;
+  this->image_width  = msg->image_width;
+  this->image_height = msg->image_height;
 
-  for (unsigned i = 0; i < msg->keypoints.size(); ++i)
+  // convert msg to opencv format: keypoints and descriptors are contiguous arrays,
+  // copied at once (descriptors are raw bytes of descriptor_type)
+  int n_pts = msg->xy.size() / 2;
+  size_t descriptor_bytes = msg->descriptor_size * CV_ELEM_SIZE(msg->descriptor_type);
+  if (msg->descriptors.size() != n_pts * descriptor_bytes)
   {
-    this->img_points[i].x = (double)msg->keypoints[i].point.x;
-    this->img_points[i].y = (double)msg->keypoints[i].point.y;
-    for (unsigned j = 0; j < DESCRIPTOR_SIZE; ++j)
-    {
-      this->descriptors.at<float>(i, j) = (float)msg->keypoints[i].descriptor[j];
-    }
+    ROS_ERROR("Frame: %lu bytes of descriptors for %d keypoints of %lu bytes", msg->descriptors.size(), n_pts,
+              descriptor_bytes);
+    return;
   }
+  const cv::Point2f* xy = reinterpret_cast< const cv::Point2f* >(msg->xy.data());
+  this->img_points.assign(xy, xy + n_pts);
+  if (msg->track_ids.size() == n_pts)
+    this->track_ids = msg->track_ids;
+  if (n_pts > 0)
+    cv::Mat(n_pts, msg->descriptor_size, msg->descriptor_type, const_cast< uint8_t* >(msg->descriptors.data()))
+        .copyTo(this->descriptors);
 }
 
 Frame::~Frame()
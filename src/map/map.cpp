@@ -10,13 +10,49 @@
 
 #include <ucl_drone/map/map.h>
 
-Map::Map() {}
+// defaults of the parameters as in launch/components/slam.xml
+Map::Map()
+  : nh(NULL)
+  , keyframe_match_factor(1.25)
+  , max_matches(200)
+  , match_ratio(0.8)
+  , cross_check(true)
+  , no_bundle_adjustment(false)
+  , only_init(false)
+  , outlier_threshold(5)
+  , manual_keyframes(false)
+  , sonar_unavailable(false)
+  , n_kf_local_ba(6)
+  , freq_global_ba(5)
+  , guided_matching(true)
+  , guided_radius(20)
+  , guided_min_matches(30)
+  , guided_ransac_iterations(300)
+  , min_dist(0.3)
+  , min_time(2)
+  , inliers_thresh(40)
+  , FOV_thresh(0.33)
+  , time_thresh(5)
+  , dist_thresh(0.5)
+  , is_adjusting_bundle(false)
+  , n_inliers_moving_avg(0)
+  , kf_since_last_global_BA(0)
+  , camera(true)
+  , manual_pose_available(false)
+  , n_dead_rows(0)
+  , first_kf_to_adjust(keyframes.end())
+  , tvec(cv::Mat::zeros(3, 1, CV_64FC1))
+  , rvec(cv::Mat::zeros(3, 1, CV_64FC1))
+  , cloud(new pcl::PointCloud< pcl::PointXYZ >())
+{
+}
 
-Map::Map(ros::NodeHandle* nh) : cloud(new pcl::PointCloud< pcl::PointXYZ >())
+Map::Map(ros::NodeHandle* nh) : Map()
 {
   cv::initModule_nonfree();  // initialize OpenCV SIFT and SURF
+  FeatureTypes::init();      // descriptor type and distance used for matching
 
-  nh = nh;
+  this->nh = nh;
   bundle_channel = nh->resolveName("bundle");
   bundle_pub     = nh->advertise<ucl_drone::BundleMsg>(bundle_channel, 1);
 
@@ -24,8 +60,10 @@ Map::Map(ros::NodeHandle* nh) : cloud(new pcl::PointCloud< pcl::PointXYZ >())
   benchmark_pub     = nh->advertise<ucl_drone::BenchmarkInfoMsg>(benchmark_channel, 1);
 
   //Get some parameters from launch file
-  ros::param::get("~thresh_descriptor_match", thresh_descriptor_match);
+  ros::param::get("~keyframe_match_factor", keyframe_match_factor);
   ros::param::get("~max_matches", max_matches);
+  ros::param::get("~match_ratio", match_ratio);
+  ros::param::get("~cross_check", cross_check);
   ros::param::get("~no_bundle_adjustment", no_bundle_adjustment);
   ros::param::get("~only_init", only_init);
   ros::param::get("~outlier_threshold", outlier_threshold);
@@ -33,6 +71,10 @@ Map::Map(ros::NodeHandle* nh) : cloud(new pcl::PointCloud< pcl::PointXYZ >())
   ros::param::get("~sonar_unavailable", sonar_unavailable);
   ros::param::get("~n_kf_local_ba", n_kf_local_ba);
   ros::param::get("~freq_global_ba", freq_global_ba);
+  ros::param::get("~guided_matching", guided_matching);
+  ros::param::get("~guided_radius", guided_radius);
+  ros::param::get("~guided_min_matches", guided_min_matches);
+  ros::param::get("~guided_ransac_iterations", guided_ransac_iterations);
 
   ros::param::get("~min_dist", min_dist);
   ros::param::get("~min_time", min_time);
@@ -44,20 +86,10 @@ Map::Map(ros::NodeHandle* nh) : cloud(new pcl::PointCloud< pcl::PointXYZ >())
   ROS_INFO("dist_thresh = %f", dist_thresh);
   ROS_INFO("init map");
 
-  is_adjusting_bundle     = false;
-  n_inliers_moving_avg    = 0;
-  kf_since_last_global_BA = 0;
-
-  camera = Camera(true);
-
   // get camera parameters in launch file
   if (!Read::CamMatrixParams("cam_matrix")) ROS_ERROR("cam_matrix not properly transmitted");
   if (!Read::ImgSizeParams("img_size"))     ROS_ERROR("img_size not properly transmitted");
 
-  // initialize empty opencv vectors
-  this->tvec = cv::Mat::zeros(3, 1, CV_64FC1);
-  this->rvec = cv::Mat::zeros(3, 1, CV_64FC1);
-
   ROS_DEBUG("map started");
 }
 
@@ -66,11 +98,17 @@ Map::~Map() {reset();}
 void Map::reset()
 {
   std::map<int,Keyframe*>::iterator it_k;
-  std::map<int,Landmark*>::iterator it_l;
   for(it_k = keyframes.begin(); it_k!=keyframes.end();++it_k) delete it_k->second;
-  for(it_l = landmarks.begin(); it_l!=landmarks.end();++it_l) delete it_l->second;
+  for(int i = 0; i < landmark_ptrs.size(); ++i) delete landmark_ptrs[i]; // NULL for dead rows
   keyframes.clear();
-  landmarks.clear();
+  landmark_IDs.clear();
+  landmark_ptrs.clear();
+  landmark_valid.clear();
+  landmark_rows.clear();
+  n_dead_rows = 0;
+  descriptors.release();
+  descriptor_index.reset();
+  track_landmarks.clear();
   cloud = boost::shared_ptr<pcl::PointCloud<pcl::PointXYZ> >(new pcl::PointCloud<pcl::PointXYZ>);
   tvec = cv::Mat::zeros(3, 1, CV_64FC1);
   rvec = cv::Mat::zeros(3, 1, CV_64FC1);
@@ -81,7 +119,9 @@ bool Map::isInitialized(){  return (keyframes.size() > 3);}
 int Map::addPoint(cv::Point3d& coordinates, cv::Mat& descriptor)
 {
   Landmark* new_landmark = new Landmark(coordinates, descriptor);
-  landmarks[new_landmark->ID] = new_landmark;
+  if (new_landmark->ID >= landmark_rows.size())
+    landmark_rows.resize(new_landmark->ID + 1, -1);
+  landmark_rows[new_landmark->ID] = landmark_IDs.size();
   pcl::PointXYZ new_point;
   new_point.x = coordinates.x;
   new_point.y = coordinates.y;
@@ -89,19 +129,95 @@ int Map::addPoint(cv::Point3d& coordinates, cv::Mat& descriptor)
   cloud->points.push_back(new_point);
   descriptors.push_back(descriptor);
   landmark_IDs.push_back(new_landmark->ID);
+  landmark_ptrs.push_back(new_landmark);
+  landmark_valid.push_back(1);
   return new_landmark->ID;
 }
 
+int Map::landmarkIndex(int ptID) const
+{
+  if (ptID < 0 || ptID >= landmark_rows.size())
+    return -1;
+  return landmark_rows[ptID];
+}
+
+int Map::landmarkCount() const
+{
+  return landmark_IDs.size() - n_dead_rows;
+}
+
+Landmark* Map::landmark(int ptID) const
+{
+  int idx = landmarkIndex(ptID);
+  return idx < 0 ? NULL : landmark_ptrs[idx];
+}
+
+int Map::landmarkRows() const { return landmark_IDs.size(); }
+
+int Map::deadLandmarkRows() const { return n_dead_rows; }
+
+bool Map::landmarkRowValid(int row) const { return landmark_valid[row]; }
+
+int Map::landmarkRowID(int row) const { return landmark_IDs[row]; }
+
+const cv::Mat& Map::landmarkDescriptors() const { return descriptors; }
+
+void Map::killLandmarkRow(int idx)
+{
+  landmark_rows[landmark_IDs[idx]] = -1;
+  landmark_IDs[idx]   = -1;
+  landmark_ptrs[idx]  = NULL;
+  landmark_valid[idx] = 0;
+  // hidden from the viewer until the rows are compacted
+  cloud->points[idx].x = cloud->points[idx].y = cloud->points[idx].z = std::numeric_limits<float>::quiet_NaN();
+  cloud->is_dense = false;
+  n_dead_rows++;
+}
+
+void Map::compactLandmarks()
+{
+  if (n_dead_rows == 0)
+    return;
+  int n_rows = landmark_IDs.size();
+  int n_live = 0;
+  std::vector<int> new_rows(n_rows, -1);
+  for (int idx = 0; idx < n_rows; idx++)
+  {
+    if (!landmark_valid[idx])
+      continue;
+    new_rows[idx] = n_live;
+    if (idx != n_live)
+    {
+      landmark_IDs[n_live]  = landmark_IDs[idx];
+      landmark_ptrs[n_live] = landmark_ptrs[idx];
+      cloud->points[n_live] = cloud->points[idx];
+      descriptors.row(idx).copyTo(descriptors.row(n_live));
+      landmark_rows[landmark_IDs[n_live]] = n_live;
+    }
+    n_live++;
+  }
+  landmark_IDs.resize(n_live);
+  landmark_ptrs.resize(n_live);
+  landmark_valid.assign(n_live, 1);
+  cloud->points.resize(n_live);
+  cloud->width    = n_live;
+  cloud->height   = 1;
+  cloud->is_dense = true;
+  descriptors.pop_back(n_rows - n_live);  // keeps the buffer for the next landmarks
+  descriptor_index.rowsMoved(new_rows);
+  ROS_DEBUG("compacted landmarks: %d dead rows removed, %d left", n_dead_rows, n_live);
+  n_dead_rows = 0;
+}
+
 void Map::updatePoint(int ptID, cv::Point3d coordinates)
 {
-  std::map<int,Landmark*>::iterator it = landmarks.find(ptID);
-  if (it==landmarks.end())
+  int idx = landmarkIndex(ptID);
+  if (idx < 0)
   {
     ROS_INFO("Trying to update point %d, but it doesn't exist",ptID);
     return;
   }
-  it->second->updateCoords(coordinates);
-  int idx = std::distance(landmarks.begin(),it);
+  landmark_ptrs[idx]->updateCoords(coordinates);
   pcl::PointXYZ new_point;
   new_point.x = coordinates.x;
   new_point.y = coordinates.y;
@@ -113,15 +229,12 @@ void Map::updatePoint(int ptID, cv::Point3d coordinates)
 void Map::removePoint(int ptID)
 {
   bool keyframe_is_dead;
-  std::map<int,Landmark*>::iterator it = landmarks.find(ptID);
-  if(it==landmarks.end())
+  Landmark* lm = landmark(ptID);
+  if (lm == NULL)
   {
     ROS_INFO("Trying to remove point %d but it doesn't exist",ptID);
     return;
   }
-  int idx = std::distance(landmarks.begin(),it);
-  landmark_IDs.erase(landmark_IDs.begin()+idx);
-  Landmark* lm = it->second;
   std::set<int>::iterator it2;
   for (it2 = lm->keyframes_seeing.begin(); it2!=lm->keyframes_seeing.end();++it2)
   {
@@ -130,26 +243,12 @@ void Map::removePoint(int ptID)
     if (keyframe_is_dead&&(keyframes.size()>1))
       removeKeyframe(*it2);
   }
+  int idx = landmarkIndex(ptID);
+  if (idx >= 0)
+    killLandmarkRow(idx);
   delete lm;
-  landmarks.erase(ptID);
-  cloud->erase(cloud->begin() + idx);
-
-  // Removing a row from descriptors
-  cv::Mat temp(descriptors.rows - 1,descriptors.cols, descriptors.type());
-  cv::Mat t1;   // Result
-  if (idx > 0)  // Copy everything above that one idx.
-  {
-    cv::Rect rect(0, 0, descriptors.cols, idx);
-    descriptors(rect).copyTo(temp(rect));
-  }
-
-  if (idx < descriptors.rows-1) // Copy everything below that one idx.
-  {
-    cv::Rect rect1(0, idx+1, descriptors.cols, descriptors.rows - idx - 1 );
-    cv::Rect rect2(0, idx,   descriptors.cols, descriptors.rows - idx - 1 );
-    descriptors(rect1).copyTo(temp(rect2));
-  }
-  descriptors = temp;
+  if (n_dead_rows > max_dead_fraction * landmark_IDs.size())
+    compactLandmarks();
 }
 
 void Map::removeKeyframe(int kfID)
@@ -169,7 +268,7 @@ void Map::removeKeyframe(int kfID)
     if (lmID >= 0)
     {
       ROS_INFO("removing point %d from keyframe %d",lmID,kfID);
-      point_is_dead = landmarks[lmID]->setAsUnseenBy(kfID);
+      point_is_dead = landmark(lmID)->setAsUnseenBy(kfID);
       if (point_is_dead) removePoint(lmID);
     }
   }
@@ -181,7 +280,7 @@ void Map::removeKeyframe(int kfID)
 void Map::setPointAsSeen(int ptID, int kfID, int idx_in_kf)
 {
   ROS_DEBUG("setting point %d as seen by keyframe %d",ptID,kfID);
-  landmarks[ptID]->setAsSeenBy(kfID);
+  landmark(ptID)->setAsSeenBy(kfID);
   keyframes[kfID]->setAsSeeing(ptID, idx_in_kf);
 }
 
@@ -192,7 +291,8 @@ void Map::matchKeyframes(Keyframe* kf0, Keyframe* kf1)
   int i, nmatch, ptID, ptID_kf0, ptID_kf1, n_new_pts;
   cv::Point3d point3D;
   std::vector<int> idx_kf0, idx_kf1;
-  matchDescriptors(kf0->descriptors, kf1->descriptors, kf0->point_IDs, kf1->point_IDs, idx_kf0, idx_kf1, thresh_descriptor_match, max_matches);
+  MatchOptions options(keyframe_match_factor * FeatureTypes::dist_threshold(), match_ratio, cross_check, max_matches);
+  matchDescriptors(kf0->descriptors, kf1->descriptors, kf0->point_IDs, kf1->point_IDs, idx_kf0, idx_kf1, options);
   nmatch = idx_kf0.size();
   n_new_pts = 0;
   for (i = 0; i<nmatch; i++)
@@ -207,7 +307,11 @@ void Map::matchKeyframes(Keyframe* kf0, Keyframe* kf1)
       triangulate(point3D, kf0, kf1, idx_kf0[i], idx_kf1[i]);
       if (pointIsVisible(*kf0,point3D,-0.5) && pointIsVisible(*kf1,point3D,-0.5))
       {
-        cv::Mat new_descriptor = 0.5*(kf0->descriptors.row(idx_kf0[i])+kf1->descriptors.row(idx_kf1[i]));
+        cv::Mat new_descriptor;
+        if (FeatureTypes::is_binary()) // averaging bit strings is meaningless
+          new_descriptor = kf0->descriptors.row(idx_kf0[i]).clone();
+        else
+          new_descriptor = 0.5*(kf0->descriptors.row(idx_kf0[i])+kf1->descriptors.row(idx_kf1[i]));
         ptID = addPoint(point3D, new_descriptor);
         setPointAsSeen(ptID, kf0->ID, idx_kf0[i]);
         setPointAsSeen(ptID, kf1->ID, idx_kf1[i]);
@@ -227,6 +331,56 @@ void Map::matchKeyframes(Keyframe* kf0, Keyframe* kf1)
   ROS_INFO("Matching keyframe %d with keyframe %d. There are %d new points",kf0->ID, kf1->ID, n_new_pts);
 }
 
+void Map::matchWithMap(const cv::Mat& query, std::vector<int>& map_indices, std::vector<int>& query_indices)
+{
+  MatchOptions options(FeatureTypes::dist_threshold(), match_ratio, cross_check);
+  // both paths search the map for the nearest landmarks of each frame descriptor
+  if (FeatureTypes::brute_force()) // exact, no index to build
+    matchDescriptors(query, descriptors, query_indices, map_indices, options, NULL, &landmark_valid);
+  else
+    matchDescriptors(descriptor_index, descriptors, landmark_valid, query, map_indices, query_indices, options);
+}
+
+bool Map::matchGuided(const Frame& frame, const std::vector<int>& keypoints, const cv::Mat& keypoints_descriptors,
+                      const std::vector<char>& landmark_used, int n_associated, std::vector<int>& map_indices,
+                      std::vector<int>& keypoint_indices)
+{
+  // camera at the prior pose: x_cam = world2cam * (x_world - origin)
+  cv::Mat drone2world, origin;
+  getCameraPositionMatrices(frame.pose, drone2world, origin, true);
+  cv::Mat_<double> world2cam = (drone2world * camera.get_R()).t();
+  double ox = origin.at<double>(0, 0), oy = origin.at<double>(1, 0), oz = origin.at<double>(2, 0);
+
+  // live landmarks in front of the camera, projected in the image (or just outside)
+  std::vector<cv::Point2f> projections;
+  std::vector<int> rows;
+  for (int idx = 0; idx < landmark_IDs.size(); idx++)
+  {
+    if (!landmark_valid[idx] || landmark_used[idx])
+      continue;
+    double dx = cloud->points[idx].x - ox, dy = cloud->points[idx].y - oy, dz = cloud->points[idx].z - oz;
+    double z = world2cam(2, 0) * dx + world2cam(2, 1) * dy + world2cam(2, 2) * dz;
+    if (z <= 0)
+      continue;
+    double u = camera.fx * (world2cam(0, 0) * dx + world2cam(0, 1) * dy + world2cam(0, 2) * dz) / z + camera.cx;
+    double v = camera.fy * (world2cam(1, 0) * dx + world2cam(1, 1) * dy + world2cam(1, 2) * dz) / z + camera.cy;
+    if (u < -guided_radius || u > frame.image_width + guided_radius ||
+        v < -guided_radius || v > frame.image_height + guided_radius)
+      continue;
+    projections.push_back(cv::Point2f(u, v));
+    rows.push_back(idx);
+  }
+
+  std::vector<cv::Point2f> points(keypoints.size());
+  for (unsigned k = 0; k < keypoints.size(); k++)
+    points[k] = frame.img_points[keypoints[k]];
+  matchProjections(projections, rows, descriptors, points, keypoints_descriptors, guided_radius,
+                   FeatureTypes::dist_threshold(), map_indices, keypoint_indices);
+  ROS_DEBUG("matchGuided: %lu landmarks projected, %lu matched", projections.size(), map_indices.size());
+  // keypoints associated by tracking count as well: most keypoints usually are
+  return n_associated + (int)map_indices.size() >= guided_min_matches;
+}
+
 void Map::matchKeyframeWithMap(Keyframe* kf)
 {
   if (kf->descriptors.rows == 0 || this->descriptors.rows == 0)
@@ -234,7 +388,7 @@ void Map::matchKeyframeWithMap(Keyframe* kf)
   int i, nmatch, ptID, pt_ID_kf, pt_idx_kf, pt_idx_map, pt_ID, n_kf_seeing;
   cv::Point3d point3D;
   std::vector<int> map_indices, keyframe_indices;
-  matchDescriptors(descriptors, kf->descriptors, map_indices, keyframe_indices, DIST_THRESHOLD,-1);
+  matchWithMap(kf->descriptors, map_indices, keyframe_indices);
 
   nmatch = keyframe_indices.size();
   for (i = 0; i<nmatch; i++)
@@ -245,7 +399,7 @@ void Map::matchKeyframeWithMap(Keyframe* kf)
     {
       pt_idx_map = map_indices[i];
       pt_ID      = landmark_IDs[pt_idx_map];
-      n_kf_seeing = landmarks[pt_ID]->keyframes_seeing.size();
+      n_kf_seeing = landmark_ptrs[pt_idx_map]->keyframes_seeing.size();
       //descriptors.row(pt_idx_map) = (n_kf_seeing*descriptors.row(pt_idx_map) + kf->descriptors.row(pt_idx_kf))/(n_kf_seeing+1);
       setPointAsSeen(pt_ID, kf->ID, pt_idx_kf);
     }
@@ -288,7 +442,7 @@ void Map::newKeyframe(Frame& frame)
     keyframes_to_adjust.push_back(it->first); //add all kfs
   }
 
-  ROS_INFO("\t Map now has %lu points",this->cloud->points.size());
+  ROS_INFO("\t Map now has %d points",landmarkCount());
   doBundleAdjustment(keyframes_to_adjust, false);
 }
 
@@ -502,16 +656,77 @@ int Map::matchWithFrame(const Frame& frame, std::vector<cv::Point3f>& inliers_ma
 {
   if (frame.descriptors.rows == 0) return -1;
   if (descriptors.rows == 0)       return -2;
-  double minx = frame.image.width;
-  double miny = frame.image.height;
+  double minx = frame.image_width;
+  double miny = frame.image_height;
   double maxx = 0;
   double maxy = 0;
   std::vector<cv::Point3f> map_matching_points;
   std::vector<cv::Point2f> frame_matching_points;
   std::vector<int> map_indices, frame_indices, inliers;
-  std::map<int,Landmark*>::iterator it;
   pcl::PointXYZ pcl_point;
-  matchDescriptors(descriptors, frame.descriptors, map_indices, frame_indices, DIST_THRESHOLD,-1);
+
+  // Keypoints still tracked since the last frame keep their landmark (the associations are
+  // rebuilt from the inliers of this frame)
+  std::map<uint32_t,int> prev_track_landmarks;
+  prev_track_landmarks.swap(track_landmarks);
+  bool has_tracks = frame.track_ids.size() == frame.img_points.size();
+  std::vector<char> landmark_used(descriptors.rows, 0);
+  std::vector<int> untracked; // keypoints to match with the descriptors of the map
+  for (int i = 0; i < frame.descriptors.rows; i++)
+  {
+    int idx = -1;
+    if (has_tracks)
+    {
+      std::map<uint32_t,int>::iterator it_track = prev_track_landmarks.find(frame.track_ids[i]);
+      if (it_track != prev_track_landmarks.end())
+        idx = landmarkIndex(it_track->second);
+    }
+    if (idx >= 0 && !landmark_used[idx])
+    {
+      map_indices.push_back(idx);
+      frame_indices.push_back(i);
+      landmark_used[idx] = 1;
+    }
+    else
+      untracked.push_back(i);
+  }
+  int n_from_tracks = map_indices.size();
+
+  // The other keypoints (new or lost tracks) are matched with the landmarks projected around them,
+  // or with the whole map if the prior pose gives too few matches
+  bool guided = false;
+  if (!untracked.empty())
+  {
+    cv::Mat untracked_descriptors;
+    if (untracked.size() < frame.descriptors.rows)
+    {
+      untracked_descriptors.create(untracked.size(), frame.descriptors.cols, frame.descriptors.type());
+      for (unsigned k = 0; k < untracked.size(); k++)
+        frame.descriptors.row(untracked[k]).copyTo(untracked_descriptors.row(k));
+    }
+    else
+      untracked_descriptors = frame.descriptors;
+    std::vector<int> new_map_indices, new_frame_indices;
+    if (guided_matching)
+      guided = matchGuided(frame, untracked, untracked_descriptors, landmark_used, n_from_tracks, new_map_indices,
+                           new_frame_indices);
+    if (!guided)
+    {
+      new_map_indices.clear();
+      new_frame_indices.clear();
+      matchWithMap(untracked_descriptors, new_map_indices, new_frame_indices);
+    }
+    for (unsigned k = 0; k < new_map_indices.size(); k++)
+    {
+      if (landmark_used[new_map_indices[k]])
+        continue;
+      map_indices.push_back(new_map_indices[k]);
+      frame_indices.push_back(untracked[new_frame_indices[k]]);
+      landmark_used[new_map_indices[k]] = 1;
+    }
+  }
+  ROS_DEBUG("matchWithFrame: %d keypoints associated by tracking, %lu matched%s", n_from_tracks,
+            map_indices.size() - n_from_tracks, guided ? " (guided)" : "");
   if (map_indices.size() < threshold_lost)
     return -3;
   cv::Point2f img_pt;
@@ -527,39 +742,33 @@ int Map::matchWithFrame(const Frame& frame, std::vector<cv::Point3f>& inliers_ma
     if (img_pt.y < miny) miny = img_pt.y;
     if (img_pt.y > maxy) maxy = img_pt.y;
   }
-  minx /= (double)frame.image.width;  miny /= (double)frame.image.height;
-  maxx /= (double)frame.image.width;  maxy /= (double)frame.image.height;
+  minx /= (double)frame.image_width;  miny /= (double)frame.image_height;
+  maxx /= (double)frame.image_width;  maxy /= (double)frame.image_height;
   fraction_FOV_without_inliers = std::max(std::max(minx,1-maxx),std::max(miny,1-maxy));
   cv::Mat distCoeffs = (cv::Mat_< double >(1, 5) << 0, 0, 0, 0, 0);
+  // matches guided by the prior pose have few outliers: less RANSAC iterations are needed
+  int iterations = (guided || untracked.empty()) ? guided_ransac_iterations : ransac_iterations;
   cv::solvePnPRansac(map_matching_points, frame_matching_points, camera.get_K(), distCoeffs, rvec, tvec,
-                     true, 2500, 2, 100, inliers, CV_P3P);  // or: CV_EPNP and CV_ITERATIVE
+                     true, iterations, 2, 100, inliers, CV_P3P);  // or: CV_EPNP and CV_ITERATIVE
   if (inliers.size() < threshold_lost)
     return -4;
 
+  std::vector<char> is_inlier(map_indices.size(), 0);
   for (int j = 0; j < inliers.size(); j++)
   {
     int i = inliers[j];
+    is_inlier[i] = 1;
     inliers_map_matching_points.push_back(map_matching_points[i]);
     inliers_frame_matching_points.push_back(frame_matching_points[i]);
+    if (has_tracks)
+      track_landmarks[frame.track_ids[frame_indices[i]]] = landmark_IDs[map_indices[i]];
   }
-  std::sort(inliers.begin(),inliers.end());
-  std::sort(map_indices.begin(),map_indices.end());
-  std::map<int,Landmark*>::iterator landmarks_it = landmarks.begin();
-  std::vector<int> points_to_remove;
-  int next_inlier = 0;
   for (int k = 0; k<map_indices.size();k++)
   {
-    if (k==0) std::advance(landmarks_it,map_indices[k]);
-    else      std::advance(landmarks_it,map_indices[k]-map_indices[k-1]);
-    if (k==inliers[next_inlier])
-    {
-      next_inlier++;
-      landmarks_it->second->times_inlier++;
-    }
+    if (is_inlier[k])
+      landmark_ptrs[map_indices[k]]->times_inlier++;
     else
-    {
-      landmarks_it->second->times_outlier++;
-    }
+      landmark_ptrs[map_indices[k]]->times_outlier++;
   }
   return 1;
 }
@@ -619,9 +828,10 @@ void Map::doBundleAdjustment(std::vector<int> kfIDs, bool is_global)
     }
     ROS_DEBUG("done with observations of point %d",ptID);
     msg->points_ID[i] = ptID;
-    msg->points[i].x = landmarks[ptID]->coordinates.x;
-    msg->points[i].y = landmarks[ptID]->coordinates.y;
-    msg->points[i].z = landmarks[ptID]->coordinates.z;
+    Landmark* lm = landmark(ptID);
+    msg->points[i].x = lm->coordinates.x;
+    msg->points[i].y = lm->coordinates.y;
+    msg->points[i].z = lm->coordinates.z;
     ROS_DEBUG("done with point %d",ptID);
     ++points_it;
   }
@@ -676,14 +886,17 @@ void Map::updateBundle(const ucl_drone::BundleMsg::ConstPtr bundlePtr)
   for (i = 0; i < npt; ++i)
   {
     ptID = bundlePtr->points_ID[i];
-    n_kf_seeing_this_pt = landmarks[ptID]->keyframes_seeing.size();
+    Landmark* lm = landmark(ptID);
+    if (lm == NULL) // removed while the bundle was adjusted
+      continue;
+    n_kf_seeing_this_pt = lm->keyframes_seeing.size();
     bool remove_this_point = outlier_threshold > 0 && bundlePtr->cost_of_point[i] > outlier_threshold;
 
 
     std::set<int>::iterator it;
-    for (it = landmarks[ptID]->keyframes_seeing.begin();it != landmarks[ptID]->keyframes_seeing.end(); ++it)
+    for (it = lm->keyframes_seeing.begin();it != lm->keyframes_seeing.end(); ++it)
     {
-      if (!pointIsVisible(*keyframes[*it], landmarks[ptID]->coordinates,0)) remove_this_point = true;
+      if (!pointIsVisible(*keyframes[*it], lm->coordinates,0)) remove_this_point = true;
     }
 
     if (remove_this_point && n_kf_seeing_this_pt == 2)
@@ -694,9 +907,9 @@ void Map::updateBundle(const ucl_drone::BundleMsg::ConstPtr bundlePtr)
     else if (remove_this_point && n_kf_seeing_this_pt > 2)
     {
       //remove last observation of this point
-      int kfID = *(landmarks[ptID]->keyframes_seeing.rbegin());
+      int kfID = *(lm->keyframes_seeing.rbegin());
       int pt_idx_kf = keyframes[kfID]->point_indices[ptID];
-      landmarks[ptID]->setAsUnseenBy(kfID);
+      lm->setAsUnseenBy(kfID);
       keyframes[kfID]->point_IDs[pt_idx_kf] = -2;
       keyframes[kfID]->point_indices.erase(ptID);
       keyframes[kfID]->n_mapped_pts--;
@@ -743,7 +956,7 @@ void Map::publishBenchmarkInfo()
 {
   ucl_drone::BenchmarkInfoMsg::Ptr msg(new ucl_drone::BenchmarkInfoMsg);
 
-  msg->pts_map = landmarks.size();
+  msg->pts_map = landmarkCount();
   msg->keyframes_pose.resize(keyframes.size());
   msg->keyframes_ID.resize(keyframes.size());
   msg->n_pts_keyframe.resize(keyframes.size());
@@ -773,16 +986,18 @@ void Map::print_info()
 
 void Map::print_landmarks()
 {
-  int npts = landmarks.size();
+  int npts = landmarkCount();
   ROS_INFO("printing all (%d) landmarks:",npts);
-  std::map<int,Landmark*>::iterator it;
-  for (it = landmarks.begin(); it != landmarks.end();++it)
+  for (int i = 0; i < landmark_ptrs.size(); ++i)
   {
-    it->second->print();
+    Landmark* lm = landmark_ptrs[i];
+    if (lm == NULL) // dead row
+      continue;
+    lm->print();
     std::cout<<"                                  At indices: ";
     std::set<int>::iterator it2;
-    for(it2 = it->second->keyframes_seeing.begin();it2!=it->second->keyframes_seeing.end();++it2)
-    it2==it->second->keyframes_seeing.begin() ? std::cout<<keyframes[*it2]->point_indices[it->first] : std::cout<<", "<<keyframes[*it2]->point_indices[it->first];
+    for(it2 = lm->keyframes_seeing.begin();it2!=lm->keyframes_seeing.end();++it2)
+    it2==lm->keyframes_seeing.begin() ? std::cout<<keyframes[*it2]->point_indices[lm->ID] : std::cout<<", "<<keyframes[*it2]->point_indices[lm->ID];
     std::cout << std::endl;
   }
 }
@@ -860,7 +1075,7 @@ void Map::print_benchmark_info()
   std::map<int,Keyframe*>::iterator it_k;
   for(it_k = keyframes.begin(); it_k!=keyframes.end();++it_k)
     tot_obs += it_k->second->n_mapped_pts;
-  int npts = landmarks.size();
+  int npts = landmarkCount();
   double avg_obs = (double)tot_obs/(double)npts;
   ROS_INFO("npts = %d ; average number of keyframes per landmark = %f",npts,avg_obs);
 }
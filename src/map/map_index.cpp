@@ -0,0 +1,214 @@
+/*
+ *  This file is part of ucl_drone 2017.
+ *  For more information, please refer
+ *  to the corresponding header file.
+ *
+ *  \author Boris Dehem
+ *  \date 2017
+ *
+ */
+
+#include <ucl_drone/map/map_index.h>
+
+#include <algorithm>
+
+#include <boost/bind.hpp>
+
+#include <ucl_drone/computer_vision/brute_force_matcher.h>
+#include <ucl_drone/computer_vision/feature_types.h>
+
+MapIndex::MapIndex()
+  : snapshot_dead(0), delta_start(0), version(0), building(false), built_version(0), build_delta_start(0)
+{
+}
+
+MapIndex::MapIndex(const MapIndex& other)
+  : snapshot_dead(0), delta_start(0), version(0), building(false), built_version(0), build_delta_start(0)
+{
+}
+
+MapIndex& MapIndex::operator=(const MapIndex& other)
+{
+  waitForBuild();
+  reset();  // a snapshot built meanwhile has an older version: it is discarded
+  return *this;
+}
+
+MapIndex::~MapIndex() { waitForBuild(); }
+
+void MapIndex::waitForBuild()
+{
+  if (builder.joinable())
+    builder.join();
+}
+
+bool MapIndex::hasSnapshot() const { return !index.empty(); }
+
+void MapIndex::reset()
+{
+  index.release();
+  indexed.release();
+  snapshot_map.clear();
+  snapshot_dead = 0;
+  delta_start   = 0;
+  build_map.clear();
+  build_delta_start = 0;
+  version++;
+}
+
+//! Apply new_rows to the map rows of a snapshot, return the number of its rows removed
+static int remapRows(const std::vector<int>& new_rows, std::vector<int>& rows, int& delta_start)
+{
+  int n_removed = 0;
+  for (unsigned i = 0; i < rows.size(); i++)
+  {
+    if (rows[i] >= 0)
+      rows[i] = new_rows[rows[i]];
+    if (rows[i] < 0)
+      n_removed++;
+  }
+  // the order of the rows is kept: the rows added since the snapshot still come after the others
+  int new_start = 0;
+  for (int row = 0; row < delta_start; row++)
+    if (new_rows[row] >= 0)
+      new_start++;
+  delta_start = new_start;
+  return n_removed;
+}
+
+void MapIndex::rowsMoved(const std::vector<int>& new_rows)
+{
+  snapshot_dead = remapRows(new_rows, snapshot_map, delta_start);
+  remapRows(new_rows, build_map, build_delta_start);
+}
+
+void MapIndex::build(cv::Mat indexed, int version)
+{
+  cv::Ptr<cv::flann::Index> new_index = FeatureTypes::createIndex(indexed);
+  boost::mutex::scoped_lock lock(build_mutex);
+  built_index   = new_index;
+  built_indexed = indexed;
+  built_version = version;
+  building      = false;
+}
+
+void MapIndex::update(const cv::Mat& descriptors, const std::vector<char>& valid)
+{
+  boost::mutex::scoped_lock lock(build_mutex);
+  if (!built_index.empty())
+  {
+    if (built_version == version)
+    {
+      index       = built_index;
+      indexed     = built_indexed;
+      snapshot_map.swap(build_map);
+      delta_start = build_delta_start;
+      snapshot_dead = std::count(snapshot_map.begin(), snapshot_map.end(), -1);
+      ROS_DEBUG("MapIndex: snapshot of %lu rows swapped in", snapshot_map.size());
+    }
+    built_index.release();
+    built_indexed.release();
+    build_map.clear();
+  }
+  if (building || descriptors.rows < min_snapshot_rows)
+    return;
+
+  int added_live = std::count(valid.begin() + delta_start, valid.begin() + descriptors.rows, 1);
+  int snapshot_live = snapshot_map.size() - snapshot_dead;
+  if (added_live <= rebuild_fraction * snapshot_live && snapshot_dead <= rebuild_fraction * snapshot_map.size())
+    return;
+
+  // the builder works on its own copy of the live rows: the rows of the map may change meanwhile
+  build_map.clear();
+  for (int row = 0; row < descriptors.rows; row++)
+    if (valid[row])
+      build_map.push_back(row);
+  build_delta_start = descriptors.rows;
+  cv::Mat live(build_map.size(), descriptors.cols, descriptors.type());
+  for (unsigned i = 0; i < build_map.size(); i++)
+    descriptors.row(build_map[i]).copyTo(live.row(i));
+  cv::Mat copy = FeatureTypes::indexable(live);
+  waitForBuild();
+  building = true;
+  builder  = boost::thread(boost::bind(&MapIndex::build, this, copy, version));
+}
+
+void MapIndex::searchSnapshot(const std::vector<char>& valid, const cv::Mat& query,
+                              std::vector<std::vector<cv::DMatch> >& matches, int k)
+{
+  int n_rows = snapshot_map.size();
+  int norm   = FeatureTypes::norm_type();
+  int n_search = std::min(std::max(snapshot_neighbours, k + 2), n_rows);
+  if (n_search == 0)
+    return;
+  std::vector<int> pending(query.rows); // query rows with less than k live neighbours
+  for (int i = 0; i < query.rows; i++)
+    pending[i] = i;
+
+  while (!pending.empty())
+  {
+    cv::Mat pending_query(pending.size(), query.cols, query.type());
+    for (unsigned j = 0; j < pending.size(); j++)
+      query.row(pending[j]).copyTo(pending_query.row(j));
+    std::vector<std::vector<cv::DMatch> > snapshot_matches;
+    flannKnnMatch(*index, pending_query, snapshot_matches, n_search, norm);
+
+    std::vector<int> still_pending;
+    for (unsigned j = 0; j < pending.size(); j++)
+    {
+      int i = pending[j];
+      matches[i].clear();
+      for (unsigned n = 0; n < snapshot_matches[j].size() && (int)matches[i].size() < k; n++)
+      {
+        int row = snapshot_map[snapshot_matches[j][n].trainIdx];
+        if (row >= 0 && valid[row])
+          matches[i].push_back(cv::DMatch(i, row, snapshot_matches[j][n].distance));
+      }
+      if ((int)matches[i].size() < k)
+        still_pending.push_back(i);
+    }
+    // dead rows hid some neighbours: search again further
+    if (n_search == n_rows)
+      break;
+    n_search = std::min(2 * n_search, n_rows);
+    pending.swap(still_pending);
+  }
+}
+
+void MapIndex::knnMatch(const cv::Mat& descriptors, const std::vector<char>& valid, const cv::Mat& query,
+                        std::vector<std::vector<cv::DMatch> >& matches, int k)
+{
+  matches.clear();
+  matches.resize(query.rows);
+  if (query.rows == 0 || descriptors.rows == 0)
+    return;
+  update(descriptors, valid);
+
+  // rows in the snapshot
+  if (!index.empty())
+    searchSnapshot(valid, query, matches, k);
+
+  // rows added since the snapshot: k live neighbours are among the k + n_dead nearest
+  int n_added = descriptors.rows - delta_start;
+  if (n_added == 0)
+    return;
+  int n_dead = std::count(valid.begin() + delta_start, valid.begin() + descriptors.rows, 0);
+  std::vector<std::vector<cv::DMatch> > added_matches;
+  bruteForceKnnMatch(query, descriptors.rowRange(delta_start, descriptors.rows), added_matches,
+                     std::min(k + n_dead, n_added), FeatureTypes::norm_type());
+
+  for (int i = 0; i < query.rows; i++)
+  {
+    std::vector<cv::DMatch>& neighbours = matches[i];
+    unsigned n_snapshot = neighbours.size();
+    for (unsigned n = 0; n < added_matches[i].size() && neighbours.size() < n_snapshot + k; n++)
+    {
+      int row = delta_start + added_matches[i][n].trainIdx;
+      if (valid[row])
+        neighbours.push_back(cv::DMatch(i, row, added_matches[i][n].distance));
+    }
+    std::sort(neighbours.begin(), neighbours.end());
+    if ((int)neighbours.size() > k)
+      neighbours.resize(k);
+  }
+}
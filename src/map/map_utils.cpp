@@ -9,33 +9,118 @@
  */
 
 #include <ucl_drone/map/map_utils.h>
+#include <ucl_drone/computer_vision/descriptor_distance.h>
 
 void matchDescriptors(const cv::Mat& descriptors1, const cv::Mat& descriptors2,
-  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, double threshold, int max_matches)
+  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, const MatchOptions& options,
+  const std::vector<char>* valid1, const std::vector<char>* valid2)
 {
-  cv::FlannBasedMatcher matcher;
   std::vector<cv::DMatch> simple_matches;
-  std::vector<int>::iterator it;
-  int train_idx;
-  matcher.match(descriptors1, descriptors2, simple_matches);
-  int nmatch = simple_matches.size();
-  std::sort(simple_matches.begin(), simple_matches.end());
-
-  if((max_matches < 0)||(max_matches > nmatch))
-    max_matches = nmatch;
-  for (unsigned k = 0; k < max_matches; k++)
+  matchUnique(descriptors1, descriptors2, options, simple_matches, valid1, valid2);
+  for (unsigned k = 0; k < simple_matches.size(); k++)
   {
-    if ((simple_matches[k].distance > threshold))
-      break;
-    it = find(matching_indices_2.begin(),matching_indices_2.end(),simple_matches[k].trainIdx);
-    if (it==matching_indices_2.end())
+    matching_indices_1.push_back(simple_matches[k].queryIdx);
+    matching_indices_2.push_back(simple_matches[k].trainIdx);
+  }
+}
+
+void matchDescriptors(MapIndex& index, const cv::Mat& map_descriptors, const std::vector<char>& valid,
+  const cv::Mat& descriptors2, std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2,
+  const MatchOptions& options)
+{
+  std::vector<std::vector<cv::DMatch> > knn_matches; // queryIdx in descriptors2, trainIdx in the map
+  index.knnMatch(map_descriptors, valid, descriptors2, knn_matches, options.ratio > 0 ? 2 : 1);
+  std::vector<cv::DMatch> simple_matches;
+  filterKnnMatches(knn_matches, map_descriptors.rows, options, simple_matches);
+  for (unsigned k = 0; k < simple_matches.size(); k++)
+  {
+    matching_indices_1.push_back(simple_matches[k].trainIdx);
+    matching_indices_2.push_back(simple_matches[k].queryIdx);
+  }
+}
+
+void matchProjections(const std::vector<cv::Point2f>& projections, const std::vector<int>& rows,
+  const cv::Mat& map_descriptors, const std::vector<cv::Point2f>& points, const cv::Mat& descriptors2,
+  double radius, double threshold, std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2)
+{
+  if (projections.empty() || points.empty())
+    return;
+
+  // keypoints bucketed in cells of radius x radius pixels: all the keypoints within radius of a
+  // projection are in the 3 x 3 cells around it
+  double cell = std::max(radius, 1.0);
+  float max_x = 0, max_y = 0;
+  for (unsigned i = 0; i < points.size(); i++)
+  {
+    max_x = std::max(max_x, points[i].x);
+    max_y = std::max(max_y, points[i].y);
+  }
+  int grid_cols = max_x / cell + 1;
+  int grid_rows = max_y / cell + 1;
+  std::vector<std::vector<int> > grid(grid_cols * grid_rows);
+  for (unsigned i = 0; i < points.size(); i++)
+  {
+    int gx = std::max(0, (int)(points[i].x / cell));
+    int gy = std::max(0, (int)(points[i].y / cell));
+    grid[gy * grid_cols + gx].push_back(i);
+  }
+
+  // best keypoint around each projection
+  double radius2 = radius * radius;
+  std::vector<cv::DMatch> candidates; // queryIdx in points, trainIdx in map_descriptors
+  for (unsigned k = 0; k < projections.size(); k++)
+  {
+    int gx = std::floor(projections[k].x / cell);
+    int gy = std::floor(projections[k].y / cell);
+    cv::DMatch best(-1, rows[k], threshold);
+    for (int y = std::max(gy - 1, 0); y <= std::min(gy + 1, grid_rows - 1); y++)
     {
-      matching_indices_1.push_back(simple_matches[k].queryIdx);
-      matching_indices_2.push_back(simple_matches[k].trainIdx);
+      for (int x = std::max(gx - 1, 0); x <= std::min(gx + 1, grid_cols - 1); x++)
+      {
+        const std::vector<int>& bucket = grid[y * grid_cols + x];
+        for (unsigned n = 0; n < bucket.size(); n++)
+        {
+          cv::Point2f diff = points[bucket[n]] - projections[k];
+          if (diff.x * diff.x + diff.y * diff.y > radius2)
+            continue;
+          float d = descriptorDistance(descriptors2, bucket[n], map_descriptors, rows[k]);
+          if (d <= best.distance)
+          {
+            best.queryIdx = bucket[n];
+            best.distance = d;
+          }
+        }
+      }
     }
+    if (best.queryIdx >= 0)
+      candidates.push_back(best);
+  }
+
+  // closest pairs first, each landmark and keypoint used once
+  std::sort(candidates.begin(), candidates.end());
+  std::vector<char> point_used(points.size(), 0);
+  std::vector<char> row_used(map_descriptors.rows, 0);
+  for (unsigned k = 0; k < candidates.size(); k++)
+  {
+    if (point_used[candidates[k].queryIdx] || row_used[candidates[k].trainIdx])
+      continue;
+    point_used[candidates[k].queryIdx] = 1;
+    row_used[candidates[k].trainIdx]   = 1;
+    matching_indices_1.push_back(candidates[k].trainIdx);
+    matching_indices_2.push_back(candidates[k].queryIdx);
   }
 }
 
+float descriptorDistance(const cv::Mat& descriptors1, int i1, const cv::Mat& descriptors2, int i2)
+{
+  int n = descriptors1.cols;
+  if (FeatureTypes::is_binary())
+    return DescriptorDistance::hamming(descriptors1.ptr<uint8_t>(i1), descriptors2.ptr<uint8_t>(i2), n);
+  if (descriptors1.type() == CV_8U) // quantized
+    return std::sqrt((float)DescriptorDistance::l2sqr(descriptors1.ptr<uint8_t>(i1), descriptors2.ptr<uint8_t>(i2), n));
+  return std::sqrt(DescriptorDistance::l2sqr(descriptors1.ptr<float>(i1), descriptors2.ptr<float>(i2), n));
+}
+
 bool pointIsVisible(const Keyframe kf, const cv::Point3d& point3D, double thresh)
 {
   cv::Mat point = (cv::Mat_<double>(3, 1) << point3D.x, point3D.y, point3D.z);
@@ -88,29 +173,22 @@ double poseDistance(const ucl_drone::Pose3D& pose0, const ucl_drone::Pose3D& pos
 
 void matchDescriptors(const cv::Mat& descriptors1, const cv::Mat& descriptors2,
   const std::vector<int>& ptIDs1, const std::vector<int>& ptIDs2,
-  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, double threshold, int max_matches)
+  std::vector<int>& matching_indices_1, std::vector<int>& matching_indices_2, const MatchOptions& options)
 {
-  cv::FlannBasedMatcher matcher;
-  std::vector<cv::DMatch> simple_matches;
-  std::vector<int>::iterator it;
-  int train_idx;
   TIC(match);
-  matcher.match(descriptors1, descriptors2, simple_matches);
-  int nmatch = simple_matches.size();
-  std::sort(simple_matches.begin(), simple_matches.end());
+  // observations of mapped landmarks are left out of the search
+  std::vector<char> unmapped1(ptIDs1.size()), unmapped2(ptIDs2.size());
+  for (unsigned i = 0; i < ptIDs1.size(); i++)
+    unmapped1[i] = ptIDs1[i] < 0;
+  for (unsigned i = 0; i < ptIDs2.size(); i++)
+    unmapped2[i] = ptIDs2[i] < 0;
 
-  if((max_matches < 0)||(max_matches > nmatch))
-    max_matches = nmatch;
-  for (unsigned k = 0; k < max_matches; k++)
+  std::vector<cv::DMatch> simple_matches;
+  matchUnique(descriptors1, descriptors2, options, simple_matches, &unmapped1, &unmapped2);
+  for (unsigned k = 0; k < simple_matches.size(); k++)
   {
-    if ((simple_matches[k].distance > threshold))
-      break;
-    it = find(matching_indices_2.begin(),matching_indices_2.end(),simple_matches[k].trainIdx);
-    if (it==matching_indices_2.end()&&ptIDs1[simple_matches[k].queryIdx]<0&&ptIDs2[simple_matches[k].trainIdx]<0)
-    {
-      matching_indices_1.push_back(simple_matches[k].queryIdx);
-      matching_indices_2.push_back(simple_matches[k].trainIdx);
-    }
+    matching_indices_1.push_back(simple_matches[k].queryIdx);
+    matching_indices_2.push_back(simple_matches[k].trainIdx);
   }
   TOC_DISPLAY(match,"matching");
 }
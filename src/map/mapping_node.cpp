@@ -18,12 +18,17 @@ MappingNode::MappingNode() : visualizer(new pcl::visualization::PCLVisualizer("3
   end_reset_pose_channel  = nh.resolveName("end_reset_pose");
   bundled_channel         = nh.resolveName("bundled");
   mpe_channel             = nh.resolveName("manual_pose_estimation");
+  // targets of the camera searching them (e.g. bottom/processed_image/targets with two cameras)
+  std::string targets_topic = "processed_image/targets";
+  ros::param::get("~targets_channel", targets_topic);
+  targets_channel         = nh.resolveName(targets_topic);
   strategy_sub        = nh.subscribe(strategy_channel,       10, &MappingNode::strategyCb,       this);
   processed_image_sub = nh.subscribe(processed_image_channel, 1, &MappingNode::processedImageCb, this);
   reset_pose_sub      = nh.subscribe(reset_pose_channel,      1, &MappingNode::resetPoseCb,      this);
   end_reset_pose_sub  = nh.subscribe(end_reset_pose_channel,  1, &MappingNode::endResetPoseCb,   this);
   bundled_sub         = nh.subscribe(bundled_channel,         1, &MappingNode::bundledCb,        this);
   mpe_sub             = nh.subscribe(mpe_channel,             1, &MappingNode::manualPoseCb,     this);
+  targets_sub         = nh.subscribe(targets_channel,         1, &MappingNode::targetsCb,        this);
 
   // Publishers
   pose_visual_channel     = nh.resolveName("pose_visual");
@@ -107,9 +112,16 @@ void MappingNode::processedImageCb(const ucl_drone::ProcessedImageMsg::ConstPtr
   bool PnP_success;
   //if (pending_reset || strategy == WAIT || strategy == TAKEOFF)
   //  return;
-  target_detected = processed_image_in->target_detected;
-  if (target_detected)
-    lastProcessedImgReceived = processed_image_in;
+  if (!processed_image_in->targets_async)
+  {
+    target_detected = processed_image_in->target_detected;
+    if (target_detected)
+    {
+      target_pose     = processed_image_in->pose;
+      target_center.x = processed_image_in->target_points[4].x;
+      target_center.y = processed_image_in->target_points[4].y;
+    }
+  }
   Frame current_frame(processed_image_in);
   PnP_success = map.processFrame(current_frame, PnP_pose);
   this->visualizer->updatePointCloud<pcl::PointXYZ>(map.cloud, "SIFT_cloud");
@@ -121,6 +133,17 @@ void MappingNode::processedImageCb(const ucl_drone::ProcessedImageMsg::ConstPtr
   //TOC_DISPLAY(mapprocessimage,"process an image in the map");
 }
 
+void MappingNode::targetsCb(const ucl_drone::TargetsMsg::ConstPtr targets_in)
+{
+  target_detected = targets_in->target_detected;
+  if (target_detected)
+  {
+    target_pose     = targets_in->pose;
+    target_center.x = targets_in->target_points[4].x;
+    target_center.y = targets_in->target_points[4].y;
+  }
+}
+
 void MappingNode::publishPoseVisual(ucl_drone::Pose3D PnP_pose, ucl_drone::Pose3D frame_pose)
 {
   ucl_drone::Pose3D pose_correction;
@@ -143,15 +166,13 @@ void MappingNode::targetDetectedPublisher()
   if (target_detected)
   {
     ucl_drone::TargetDetected msg;
-    msg.pose = lastProcessedImgReceived->pose;
-    msg.img_point.x = lastProcessedImgReceived->target_points[4].x;
-    msg.img_point.y = lastProcessedImgReceived->target_points[4].y;
+    msg.pose = target_pose;
+    msg.img_point.x = target_center.x;
+    msg.img_point.y = target_center.y;
     msg.img_point.z = 0;
-    std::vector< cv::Point2f > target_center(1);
-    target_center[0].x = lastProcessedImgReceived->target_points[4].x;
-    target_center[0].y = lastProcessedImgReceived->target_points[4].y;
+    std::vector< cv::Point2f > target_centers(1, target_center);
     std::vector< cv::Point3f > world_coord;
-    projection_2D(target_center, msg.pose, world_coord);
+    projection_2D(target_centers, msg.pose, world_coord);
     msg.world_point.x = world_coord[0].x;
     msg.world_point.y = world_coord[0].y;
     msg.world_point.z = world_coord[0].z;
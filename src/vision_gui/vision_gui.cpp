@@ -10,7 +10,7 @@
 
 #include <ucl_drone/vision_gui/vision_gui.h>
 
-VisionGui::VisionGui()
+VisionGui::VisionGui() : image_payload(nh_.resolveName("processed_image"))
 {
   // Instantiate the viewer widow
   cv::namedWindow(OPENCV_WINDOW1);
@@ -18,6 +18,12 @@ VisionGui::VisionGui()
   // Subscribe to processed_image (contains image + keypoints + ...)
   processed_img_channel = nh_.resolveName("processed_image");
   processed_img_sub = nh_.subscribe(processed_img_channel, 1, &VisionGui::processedImageCb, this);
+  // targets searched apart from the processed images (async_targets)
+  // targets of the camera searching them (e.g. bottom/processed_image/targets with two cameras)
+  std::string targets_topic = "processed_image/targets";
+  ros::param::get("~targets_channel", targets_topic);
+  targets_channel = nh_.resolveName(targets_topic);
+  targets_sub = nh_.subscribe(targets_channel, 1, &VisionGui::targetsCb, this);
 
   // Get parameters in launch file
   ros::param::get("~draw_keypoints", this->draw_keypoints);
@@ -37,8 +43,28 @@ void VisionGui::processedImageCb(const ucl_drone::ProcessedImageMsg::ConstPtr pr
 {
   ROS_DEBUG("VisionGui::processedImageCb start");
   this->lastProcessedImgReceived = processed_image;
-  convertMsgToAttributes(processed_image);
-  new_processed_img_available = true;
+  // images published by reference may arrive after the keypoints: this one is then skipped
+  if (convertMsgToAttributes(processed_image))
+    new_processed_img_available = true;
+}
+
+void VisionGui::targetsCb(const ucl_drone::TargetsMsg::ConstPtr targets)
+{
+  setTarget(targets->target_detected, targets->target_points);
+}
+
+void VisionGui::setTarget(bool detected, const std::vector< geometry_msgs::Point >& target_points)
+{
+  target_detected = detected;
+  if (target_detected)
+  {
+    this->target_cornersAndCenter.resize(target_points.size());
+    for (unsigned i = 0; i < target_points.size(); ++i)
+    {
+      this->target_cornersAndCenter[i].x = target_points[i].x;
+      this->target_cornersAndCenter[i].y = target_points[i].y;
+    }
+  }
 }
 
 void VisionGui::guiDrawKeypoints()
@@ -74,37 +100,19 @@ void VisionGui::guiDrawKeypoints()
   cv::waitKey(3);
 }
 
-void VisionGui::convertMsgToAttributes(ucl_drone::ProcessedImageMsg::ConstPtr msg)
+bool VisionGui::convertMsgToAttributes(ucl_drone::ProcessedImageMsg::ConstPtr msg)
 {
+  // convert ROS image to OpenCV image
+  if (!image_payload.getImage(*msg, this->cv_ptr))
+    return false;
+
   // convert points in the msg to opencv format
   // and store these as object attributes
-  this->keypoints.resize(msg->keypoints.size());
-  for (unsigned i = 0; i < msg->keypoints.size(); ++i)
-  {
-    this->keypoints[i].x = (double)msg->keypoints[i].point.x;
-    this->keypoints[i].y = (double)msg->keypoints[i].point.y;
-  }
-  target_detected = msg->target_detected;
-  if (target_detected)
-  {
-    this->target_cornersAndCenter.resize(msg->target_points.size());
-    for (unsigned i = 0; i < msg->target_points.size(); ++i)
-    {
-      this->target_cornersAndCenter[i].x = msg->target_points[i].x;
-      this->target_cornersAndCenter[i].y = msg->target_points[i].y;
-    }
-  }
-
-  // convert ROS image to OpenCV image
-  try
-  {
-    this->cv_ptr = cv_bridge::toCvCopy(msg->image, sensor_msgs::image_encodings::BGR8);
-  }
-  catch (cv_bridge::Exception& e)
-  {
-    ROS_ERROR("ucl_drone::VisionGui::cv_bridge exception: %s", e.what());
-    return;
-  }
+  const cv::Point2f* xy = reinterpret_cast< const cv::Point2f* >(msg->xy.data());
+  this->keypoints.assign(xy, xy + msg->xy.size() / 2);
+  if (!msg->targets_async)
+    setTarget(msg->target_detected, msg->target_points);
+  return true;
 }
 
 int main(int argc, char** argv)
@@ -0,0 +1,147 @@
+/*!
+ *  \file test_descriptor_distance.cpp
+ *  \brief Unit tests of the descriptor distance kernels (descriptor_distance.h): each kernel
+ *         compiled for this CPU gives the same distances as a plain loop, tails included
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ */
+
+#include <ucl_drone/computer_vision/descriptor_distance.h>
+
+#include <cmath>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+#include <gtest/gtest.h>
+
+// lengths around the SIMD widths (4, 8, 16 and 32 elements), and the usual descriptor sizes
+static const int LENGTHS[] = { 0, 1, 3, 4, 7, 8, 15, 16, 17, 31, 32, 33, 63, 64, 65, 128, 130 };
+static const int N_LENGTHS = sizeof(LENGTHS) / sizeof(LENGTHS[0]);
+
+static std::vector< float > randomFloats(int n)
+{
+  std::vector< float > v(n + 1);  // never empty, so that &v[0] is valid
+  for (int i = 0; i < n; i++)
+    v[i] = (float)std::rand() / RAND_MAX - 0.5f;
+  return v;
+}
+
+static std::vector< uint8_t > randomBytes(int n)
+{
+  std::vector< uint8_t > v(n + 1);
+  for (int i = 0; i < n; i++)
+    v[i] = std::rand() % 256;
+  return v;
+}
+
+static double l2sqrReference(const float* a, const float* b, int n)
+{
+  double d = 0;
+  for (int i = 0; i < n; i++)
+    d += ((double)a[i] - b[i]) * ((double)a[i] - b[i]);
+  return d;
+}
+
+static int l2sqrU8Reference(const uint8_t* a, const uint8_t* b, int n)
+{
+  int d = 0;
+  for (int i = 0; i < n; i++)
+    d += (a[i] - b[i]) * (a[i] - b[i]);
+  return d;
+}
+
+static int hammingReference(const uint8_t* a, const uint8_t* b, int n)
+{
+  int d = 0;
+  for (int i = 0; i < n; i++)
+    for (int bit = 0; bit < 8; bit++)
+      d += ((a[i] ^ b[i]) >> bit) & 1;
+  return d;
+}
+
+static void checkL2Sqr(DescriptorDistance::L2SqrFunc l2sqr)
+{
+  for (int t = 0; t < N_LENGTHS; t++)
+  {
+    int n = LENGTHS[t];
+    std::vector< float > a = randomFloats(n), b = randomFloats(n);
+    double expected = l2sqrReference(&a[0], &b[0], n);
+    EXPECT_NEAR(expected, l2sqr(&a[0], &b[0], n), 1e-5 * (1 + expected)) << "n = " << n;
+    EXPECT_EQ(0, l2sqr(&a[0], &a[0], n)) << "n = " << n;
+  }
+}
+
+static void checkL2SqrU8(DescriptorDistance::L2SqrU8Func l2sqr_u8)
+{
+  for (int t = 0; t < N_LENGTHS; t++)
+  {
+    int n = LENGTHS[t];
+    std::vector< uint8_t > a = randomBytes(n), b = randomBytes(n);
+    EXPECT_EQ(l2sqrU8Reference(&a[0], &b[0], n), l2sqr_u8(&a[0], &b[0], n)) << "n = " << n;
+    // largest differences (no overflow of the 16-bit products)
+    std::vector< uint8_t > zeros(n + 1, 0), full(n + 1, 255);
+    EXPECT_EQ(n * 255 * 255, l2sqr_u8(&zeros[0], &full[0], n)) << "n = " << n;
+  }
+}
+
+static void checkHamming(DescriptorDistance::HammingFunc hamming)
+{
+  for (int t = 0; t < N_LENGTHS; t++)
+  {
+    int n = LENGTHS[t];
+    std::vector< uint8_t > a = randomBytes(n), b = randomBytes(n);
+    EXPECT_EQ(hammingReference(&a[0], &b[0], n), hamming(&a[0], &b[0], n)) << "n = " << n;
+    std::vector< uint8_t > zeros(n + 1, 0), full(n + 1, 255);
+    EXPECT_EQ(8 * n, hamming(&zeros[0], &full[0], n)) << "n = " << n;
+  }
+}
+
+TEST(DescriptorDistance, Generic)
+{
+  checkL2Sqr(l2sqrGeneric);
+  checkL2SqrU8(l2sqrU8Generic);
+  checkHamming(hammingGeneric);
+}
+
+#if defined(__SSE2__)
+TEST(DescriptorDistance, SSE2)
+{
+  checkL2Sqr(l2sqrSSE2);
+  checkL2SqrU8(l2sqrU8SSE2);
+}
+#endif
+
+#if defined(UCL_DRONE_AVX2_KERNELS)
+TEST(DescriptorDistance, AVX2)
+{
+  if (std::string(DescriptorDistance::implementation()) != "AVX2")
+    return;  // not supported by this CPU
+  checkL2Sqr(l2sqrAVX2);
+  checkL2SqrU8(l2sqrU8AVX2);
+  checkHamming(hammingAVX2);
+}
+#endif
+
+#if defined(__ARM_NEON) || defined(__ARM_NEON__)
+TEST(DescriptorDistance, NEON)
+{
+  checkL2Sqr(l2sqrNEON);
+  checkL2SqrU8(l2sqrU8NEON);
+  checkHamming(hammingNEON);
+}
+#endif
+
+// the kernels chosen at runtime
+TEST(DescriptorDistance, Dispatch)
+{
+  checkL2Sqr(DescriptorDistance::l2sqr);
+  checkL2SqrU8(DescriptorDistance::l2sqr);
+  checkHamming(DescriptorDistance::hamming);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,156 @@
+/*!
+ *  \file test_map.cpp
+ *  \brief Unit tests of the landmark rows of Map: lookup of a landmark by ID, dead rows and
+ *         compaction
+ *  \authors Boris Dehem
+ *  \year 2017
+ */
+
+#include <ucl_drone/map/map.h>
+
+#include <cmath>
+
+#include <gtest/gtest.h>
+
+/** \class MapTest
+ *  Fixture with an empty map (no ROS node needed), inspected through its public API
+ */
+class MapTest : public testing::Test
+{
+protected:
+  Map map;
+
+  //! Add a landmark whose coordinates and descriptor are filled with value, return its ID
+  int add(int value)
+  {
+    cv::Point3d coordinates(value, value, value);
+    cv::Mat descriptor(1, 32, CV_8U, cv::Scalar(value));
+    return map.addPoint(coordinates, descriptor);
+  }
+
+  //! Check that the row of landmark ptID holds its coordinates and descriptor (filled with value)
+  void expectRow(int ptID, int value)
+  {
+    int row = map.landmarkIndex(ptID);
+    ASSERT_GE(row, 0);
+    EXPECT_EQ(ptID, map.landmarkRowID(row));
+    EXPECT_EQ(ptID, map.landmark(ptID)->ID);
+    EXPECT_TRUE(map.landmarkRowValid(row));
+    EXPECT_EQ(value, map.landmarkDescriptors().at< uchar >(row, 0));
+    EXPECT_EQ(value, map.cloud->points[row].x);
+  }
+
+  int index(int ptID) { return map.landmarkIndex(ptID); }
+  Landmark* landmark(int ptID) { return map.landmark(ptID); }
+  int rows() { return map.landmarkRows(); }
+  int count() { return map.landmarkCount(); }
+  int deadRows() { return map.deadLandmarkRows(); }
+  bool rowValid(int row) { return map.landmarkRowValid(row); }
+  int rowID(int row) { return map.landmarkRowID(row); }
+  int descriptorRows() { return map.landmarkDescriptors().rows; }
+  void remove(int ptID) { map.removePoint(ptID); }
+};
+
+TEST_F(MapTest, LookupByID)
+{
+  std::vector< int > IDs;
+  for (int i = 0; i < 10; i++)
+    IDs.push_back(add(i));
+  EXPECT_EQ(10, rows());
+  EXPECT_EQ(10, count());
+  for (int i = 0; i < 10; i++)
+  {
+    EXPECT_EQ(i, index(IDs[i]));
+    expectRow(IDs[i], i);
+  }
+}
+
+TEST_F(MapTest, UnknownIDs)
+{
+  int ID = add(1);
+  EXPECT_EQ(-1, index(-1));
+  EXPECT_EQ(-1, index(ID + 1));
+  EXPECT_EQ(-1, index(ID + 1000));
+  EXPECT_TRUE(landmark(-1) == NULL);
+  EXPECT_TRUE(landmark(ID + 1000) == NULL);
+}
+
+// IDs are global (Landmark::ID_counter): a new map does not start at 0
+TEST_F(MapTest, LookupAfterReset)
+{
+  int old_ID = add(1);
+  map.reset();
+  EXPECT_EQ(-1, index(old_ID));
+  int ID = add(2);
+  EXPECT_EQ(0, index(ID));
+  expectRow(ID, 2);
+}
+
+// a removed landmark leaves a dead row, the other rows do not move
+TEST_F(MapTest, RemoveLeavesDeadRow)
+{
+  std::vector< int > IDs;
+  for (int i = 0; i < 10; i++)
+    IDs.push_back(add(i));
+  remove(IDs[3]);
+  EXPECT_EQ(10, rows());
+  EXPECT_EQ(9, count());
+  EXPECT_EQ(1, deadRows());
+  EXPECT_EQ(-1, index(IDs[3]));
+  EXPECT_TRUE(landmark(IDs[3]) == NULL);
+  EXPECT_FALSE(rowValid(3));
+  EXPECT_EQ(-1, rowID(3));
+  EXPECT_TRUE(std::isnan(map.cloud->points[3].x));
+  for (int i = 0; i < 10; i++)
+    if (i != 3)
+    {
+      EXPECT_EQ(i, index(IDs[i]));
+      expectRow(IDs[i], i);
+    }
+
+  // removing it again, or an unknown landmark, changes nothing
+  remove(IDs[3]);
+  remove(-1);
+  EXPECT_EQ(1, deadRows());
+  EXPECT_EQ(9, count());
+}
+
+// rows are compacted when more than max_dead_fraction (20%) of them are dead, in the same order
+TEST_F(MapTest, Compaction)
+{
+  std::vector< int > IDs;
+  for (int i = 0; i < 10; i++)
+    IDs.push_back(add(i));
+  remove(IDs[0]);
+  remove(IDs[5]);
+  EXPECT_EQ(10, rows());  // 2 dead rows out of 10
+  remove(IDs[9]);
+  EXPECT_EQ(7, rows());
+  EXPECT_EQ(7, count());
+  EXPECT_EQ(0, deadRows());
+  EXPECT_EQ(7, descriptorRows());
+  EXPECT_EQ(7, (int)map.cloud->points.size());
+  EXPECT_TRUE(map.cloud->is_dense);
+
+  const int kept[] = { 1, 2, 3, 4, 6, 7, 8 };
+  for (int row = 0; row < 7; row++)
+  {
+    EXPECT_EQ(row, index(IDs[kept[row]]));
+    expectRow(IDs[kept[row]], kept[row]);
+  }
+  EXPECT_EQ(-1, index(IDs[0]));
+  EXPECT_EQ(-1, index(IDs[5]));
+  EXPECT_EQ(-1, index(IDs[9]));
+
+  // landmarks added after a compaction get the next rows
+  int ID = add(42);
+  EXPECT_EQ(7, index(ID));
+  expectRow(ID, 42);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::Time::init();  // creation time of the landmarks
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,227 @@
+/*!
+ *  \file test_map_index.cpp
+ *  \brief Unit tests of MapIndex::knnMatch: the rows of the snapshot and the rows added since are
+ *         merged, dead rows are skipped, and the snapshot follows a compaction
+ *  \authors Boris Dehem
+ *  \year 2017
+ *
+ *  ORB descriptors (LSH snapshot): exact copies of a map row are always found by the snapshot.
+ */
+
+#include <ucl_drone/map/map_index.h>
+
+#include <algorithm>
+
+#include <ucl_drone/computer_vision/feature_types.h>
+
+#include <gtest/gtest.h>
+
+/** \class MapIndexTest
+ *  Fixture with map descriptors, their valid flags, and an index of them
+ */
+class MapIndexTest : public testing::Test
+{
+protected:
+  static const int n_rows = 600;  // more than min_snapshot_rows
+  MapIndex index;
+  cv::Mat descriptors;
+  std::vector< char > valid;
+  cv::Mat duplicate;  // descriptor copied in several rows
+
+  virtual void SetUp()
+  {
+    cv::theRNG().state = 42;
+    duplicate.create(1, 32, CV_8U);
+    cv::randu(duplicate, cv::Scalar(0), cv::Scalar(256));
+  }
+
+  //! Add n random rows (copies of duplicate if copies is true)
+  void add(int n, bool copies = false)
+  {
+    cv::Mat rows(n, 32, CV_8U);
+    cv::randu(rows, cv::Scalar(0), cv::Scalar(256));
+    for (int i = 0; copies && i < n; i++)
+      duplicate.copyTo(rows.row(i));
+    descriptors.push_back(rows);
+    valid.resize(descriptors.rows, 1);
+  }
+
+  void search(const cv::Mat& query, std::vector< std::vector< cv::DMatch > >& matches, int k)
+  {
+    index.knnMatch(descriptors, valid, query, matches, k);
+  }
+
+  //! Build the snapshot of the current rows and swap it in
+  void buildSnapshot()
+  {
+    std::vector< std::vector< cv::DMatch > > matches;
+    search(duplicate, matches, 1);  // starts the build
+    index.waitForBuild();
+    search(duplicate, matches, 1);  // swaps it in
+  }
+
+  bool hasSnapshot() { return index.hasSnapshot(); }
+
+  //! Remove the dead rows as Map::compactLandmarks does, return the new row of each old row
+  std::vector< int > compact()
+  {
+    std::vector< int > new_rows(descriptors.rows, -1);
+    cv::Mat live;
+    for (int row = 0; row < descriptors.rows; row++)
+      if (valid[row])
+      {
+        new_rows[row] = live.rows;
+        live.push_back(descriptors.row(row));
+      }
+    descriptors = live;
+    valid.assign(descriptors.rows, 1);
+    index.rowsMoved(new_rows);
+    return new_rows;
+  }
+
+  //! Check that the neighbours are k live rows, sorted by distance
+  void expectLive(const std::vector< cv::DMatch >& neighbours, int k)
+  {
+    ASSERT_EQ(k, (int)neighbours.size());
+    for (unsigned n = 0; n < neighbours.size(); n++)
+    {
+      ASSERT_GE(neighbours[n].trainIdx, 0);
+      ASSERT_LT(neighbours[n].trainIdx, descriptors.rows);
+      EXPECT_TRUE(valid[neighbours[n].trainIdx]) << "dead row " << neighbours[n].trainIdx;
+      if (n > 0)
+        EXPECT_LE(neighbours[n - 1].distance, neighbours[n].distance);
+    }
+  }
+};
+
+// small map: brute force only, same distances as an exhaustive search of the live rows
+TEST_F(MapIndexTest, BruteForce)
+{
+  add(100);
+  for (int row = 0; row < 100; row += 3)
+    valid[row] = 0;
+  cv::Mat query = descriptors.rowRange(0, 10).clone();
+  std::vector< std::vector< cv::DMatch > > matches;
+  search(query, matches, 2);
+  EXPECT_FALSE(hasSnapshot());
+  ASSERT_EQ(10, (int)matches.size());
+  for (int i = 0; i < 10; i++)
+  {
+    expectLive(matches[i], 2);
+    if (valid[i])
+    {
+      EXPECT_EQ(i, matches[i][0].trainIdx);
+      EXPECT_EQ(0, matches[i][0].distance);
+    }
+    double best = 1e9;
+    for (int row = 0; row < descriptors.rows; row++)
+      if (valid[row])
+        best = std::min(best, cv::norm(query.row(i), descriptors.row(row), cv::NORM_HAMMING));
+    EXPECT_EQ(best, matches[i][0].distance);
+  }
+}
+
+// the nearest rows of the snapshot are dead: the search goes further to find k live ones
+TEST_F(MapIndexTest, DeadRowsInSnapshot)
+{
+  add(20, true);
+  add(n_rows - 20);
+  buildSnapshot();
+  ASSERT_TRUE(hasSnapshot());
+  for (int row = 0; row < 18; row++)
+    valid[row] = 0;
+
+  std::vector< std::vector< cv::DMatch > > matches;
+  search(duplicate, matches, 2);
+  expectLive(matches[0], 2);
+  EXPECT_EQ(18, std::min(matches[0][0].trainIdx, matches[0][1].trainIdx));
+  EXPECT_EQ(19, std::max(matches[0][0].trainIdx, matches[0][1].trainIdx));
+  EXPECT_EQ(0, matches[0][1].distance);
+
+  // a live row is its own nearest neighbour
+  search(descriptors.row(300), matches, 2);
+  expectLive(matches[0], 2);
+  EXPECT_EQ(300, matches[0][0].trainIdx);
+}
+
+// rows added since the snapshot (some dead) are merged with the rows of the snapshot
+TEST_F(MapIndexTest, MergeSnapshotAndAddedRows)
+{
+  add(2, true);
+  add(n_rows - 2);
+  buildSnapshot();
+  ASSERT_TRUE(hasSnapshot());
+  add(10, true);
+  for (int row = n_rows; row < n_rows + 6; row++)
+    valid[row] = 0;
+  valid[0] = 0;
+
+  std::vector< std::vector< cv::DMatch > > matches;
+  search(duplicate, matches, 5);
+  expectLive(matches[0], 5);  // 1, and n_rows + 6 .. n_rows + 9
+  std::vector< int > found;
+  for (int n = 0; n < 5; n++)
+  {
+    EXPECT_EQ(0, matches[0][n].distance);
+    found.push_back(matches[0][n].trainIdx);
+  }
+  std::sort(found.begin(), found.end());
+  EXPECT_EQ(1, found[0]);
+  for (int n = 1; n < 5; n++)
+    EXPECT_EQ(n_rows + 5 + n, found[n]);
+
+  // less live rows than k
+  search(duplicate, matches, 8);
+  expectLive(matches[0], 5 + 3);  // 5 copies, and the 3 nearest random rows
+}
+
+// a compaction moves the rows: the snapshot is kept and gives the new rows
+TEST_F(MapIndexTest, Compaction)
+{
+  add(20, true);
+  add(n_rows - 20);
+  buildSnapshot();
+  add(10);
+  for (int row = 0; row < 18; row++)
+    valid[row] = 0;
+  valid[n_rows + 2] = 0;
+  cv::Mat added = descriptors.row(n_rows + 5).clone();
+  cv::Mat kept  = descriptors.row(300).clone();
+  std::vector< int > new_rows = compact();
+  ASSERT_TRUE(hasSnapshot());
+
+  std::vector< std::vector< cv::DMatch > > matches;
+  search(duplicate, matches, 2);
+  expectLive(matches[0], 2);
+  EXPECT_EQ(0, std::min(matches[0][0].trainIdx, matches[0][1].trainIdx));
+  EXPECT_EQ(1, std::max(matches[0][0].trainIdx, matches[0][1].trainIdx));
+  search(kept, matches, 1);
+  EXPECT_EQ(new_rows[300], matches[0][0].trainIdx);
+  search(added, matches, 1);
+  EXPECT_EQ(new_rows[n_rows + 5], matches[0][0].trainIdx);
+  EXPECT_TRUE(hasSnapshot());
+}
+
+// a reset map forgets the snapshot
+TEST_F(MapIndexTest, Reset)
+{
+  add(n_rows);
+  buildSnapshot();
+  ASSERT_TRUE(hasSnapshot());
+  index.reset();
+  descriptors.release();
+  valid.clear();
+  add(5, true);
+  std::vector< std::vector< cv::DMatch > > matches;
+  search(duplicate, matches, 2);
+  EXPECT_FALSE(hasSnapshot());
+  expectLive(matches[0], 2);
+  EXPECT_EQ(0, matches[0][1].distance);
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  FeatureTypes::init("ORB", "ORB");
+  return RUN_ALL_TESTS();
+}
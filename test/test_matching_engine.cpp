@@ -0,0 +1,169 @@
+/*!
+ *  \file test_matching_engine.cpp
+ *  \brief Unit tests of the selection of descriptor matches (matching_engine.h): distance
+ *         threshold, ratio test, cross-check, uniqueness and budget
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ */
+
+#include <ucl_drone/computer_vision/matching_engine.h>
+
+#include <algorithm>
+
+#include <ucl_drone/computer_vision/feature_types.h>
+
+#include <gtest/gtest.h>
+
+typedef std::vector< std::vector< cv::DMatch > > KnnMatches;
+
+//! Add the neighbours of query descriptor q: (train, distance) pairs sorted by distance
+static void addQuery(KnnMatches& knn_matches, int q, int t0 = -1, float d0 = 0, int t1 = -1, float d1 = 0)
+{
+  knn_matches.resize(std::max((int)knn_matches.size(), q + 1));
+  if (t0 >= 0)
+    knn_matches[q].push_back(cv::DMatch(q, t0, d0));
+  if (t1 >= 0)
+    knn_matches[q].push_back(cv::DMatch(q, t1, d1));
+}
+
+TEST(FilterKnnMatches, MaxDistance)
+{
+  KnnMatches knn_matches;
+  addQuery(knn_matches, 0, 0, 10, 1, 50);
+  addQuery(knn_matches, 1, 1, 30, 0, 50);
+  addQuery(knn_matches, 2, 2, 20);
+  std::vector< cv::DMatch > matches;
+  filterKnnMatches(knn_matches, 3, MatchOptions(20), matches);
+  ASSERT_EQ(2u, matches.size());
+  EXPECT_EQ(0, matches[0].queryIdx);
+  EXPECT_EQ(2, matches[1].queryIdx);  // at the threshold
+}
+
+TEST(FilterKnnMatches, RatioTest)
+{
+  KnnMatches knn_matches;
+  addQuery(knn_matches, 0, 0, 10, 1, 20);  // 10 < 0.8 * 20
+  addQuery(knn_matches, 1, 1, 18, 0, 20);  // ambiguous
+  addQuery(knn_matches, 2, 2, 16, 0, 20);  // at the ratio: rejected
+  addQuery(knn_matches, 3, 3, 15);         // single neighbour: passes
+  addQuery(knn_matches, 4);                // no neighbour
+  std::vector< cv::DMatch > matches;
+  filterKnnMatches(knn_matches, 4, MatchOptions(100, 0.8), matches);
+  ASSERT_EQ(2u, matches.size());
+  EXPECT_EQ(0, matches[0].queryIdx);
+  EXPECT_EQ(3, matches[1].queryIdx);
+
+  // without ratio test
+  filterKnnMatches(knn_matches, 4, MatchOptions(100), matches);
+  EXPECT_EQ(4u, matches.size());
+}
+
+TEST(FilterKnnMatches, CrossCheck)
+{
+  KnnMatches knn_matches, reverse;
+  addQuery(knn_matches, 0, 0, 10);
+  addQuery(knn_matches, 1, 1, 10);
+  addQuery(reverse, 0, 0, 10);  // train 0 -> query 0: mutual
+  addQuery(reverse, 1, 0, 5);   // train 1 -> query 0: not mutual
+  std::vector< cv::DMatch > matches;
+  filterKnnMatches(knn_matches, 2, MatchOptions(100, 0, true), matches, &reverse);
+  ASSERT_EQ(1u, matches.size());
+  EXPECT_EQ(0, matches[0].queryIdx);
+  EXPECT_EQ(0, matches[0].trainIdx);
+
+  // the reverse matches are needed for the cross-check: ignored without them
+  filterKnnMatches(knn_matches, 2, MatchOptions(100, 0, true), matches);
+  EXPECT_EQ(2u, matches.size());
+}
+
+// each train descriptor is matched at most once, by the closest query descriptor
+TEST(FilterKnnMatches, Uniqueness)
+{
+  KnnMatches knn_matches;
+  addQuery(knn_matches, 0, 1, 30);
+  addQuery(knn_matches, 1, 1, 10);
+  addQuery(knn_matches, 2, 0, 20);
+  addQuery(knn_matches, 3, 1, 5);
+  std::vector< cv::DMatch > matches;
+  filterKnnMatches(knn_matches, 2, MatchOptions(100), matches);
+  ASSERT_EQ(2u, matches.size());
+  EXPECT_EQ(3, matches[0].queryIdx);
+  EXPECT_EQ(1, matches[0].trainIdx);
+  EXPECT_EQ(2, matches[1].queryIdx);
+  EXPECT_EQ(0, matches[1].trainIdx);
+}
+
+// the closest matches are kept first, up to max_matches
+TEST(FilterKnnMatches, Budget)
+{
+  KnnMatches knn_matches;
+  for (int q = 0; q < 10; q++)
+    addQuery(knn_matches, q, q, 100 - 10 * q);
+  std::vector< cv::DMatch > matches;
+  filterKnnMatches(knn_matches, 10, MatchOptions(100, 0, false, 3), matches);
+  ASSERT_EQ(3u, matches.size());
+  EXPECT_EQ(9, matches[0].queryIdx);
+  EXPECT_EQ(8, matches[1].queryIdx);
+  EXPECT_EQ(7, matches[2].queryIdx);
+
+  // duplicates do not use the budget
+  addQuery(knn_matches, 10, 9, 5);
+  filterKnnMatches(knn_matches, 10, MatchOptions(100, 0, false, 3), matches);
+  ASSERT_EQ(3u, matches.size());
+  EXPECT_EQ(10, matches[0].queryIdx);
+  EXPECT_EQ(8, matches[1].queryIdx);
+  EXPECT_EQ(7, matches[2].queryIdx);
+
+  filterKnnMatches(knn_matches, 10, MatchOptions(100, 0, false, 0), matches);
+  EXPECT_TRUE(matches.empty());
+}
+
+// ignored rows are left out of the search, and the matches give the rows of the full sets
+TEST(MatchUnique, ValidRows)
+{
+  cv::theRNG().state = 42;
+  cv::Mat train(10, 32, CV_8U);
+  cv::randu(train, cv::Scalar(0), cv::Scalar(256));
+  cv::Mat query;
+  for (int row = 9; row >= 0; row--)  // query row i is train row 9 - i
+    query.push_back(train.row(row));
+  std::vector< char > query_valid(10, 1), train_valid(10, 1);
+  query_valid[0] = 0;  // train row 9
+  train_valid[2] = 0;  // query row 7
+
+  std::vector< cv::DMatch > matches;
+  matchUnique(query, train, MatchOptions(10, 0.8, true), matches, &query_valid, &train_valid);
+  ASSERT_EQ(8u, matches.size());
+  for (unsigned k = 0; k < matches.size(); k++)
+  {
+    EXPECT_EQ(9 - matches[k].queryIdx, matches[k].trainIdx);
+    EXPECT_EQ(0, matches[k].distance);
+    EXPECT_TRUE(query_valid[matches[k].queryIdx]);
+    EXPECT_TRUE(train_valid[matches[k].trainIdx]);
+  }
+}
+
+// masked train rows are never neighbours, masked query rows get none
+TEST(BruteForceKnnMatch, Masks)
+{
+  cv::Mat train = (cv::Mat_< uint8_t >(4, 1) << 0, 1, 2, 8);
+  cv::Mat query = (cv::Mat_< uint8_t >(2, 1) << 0, 3);
+  std::vector< char > query_valid(2, 1), train_valid(4, 1);
+  query_valid[1] = 0;
+  train_valid[0] = 0;
+
+  KnnMatches knn_matches;
+  bruteForceKnnMatch(query, train, knn_matches, 2, cv::NORM_L2, &query_valid, &train_valid);
+  ASSERT_EQ(2u, knn_matches.size());
+  ASSERT_EQ(2u, knn_matches[0].size());
+  EXPECT_EQ(1, knn_matches[0][0].trainIdx);  // row 0 is the exact match, but masked
+  EXPECT_EQ(2, knn_matches[0][1].trainIdx);
+  EXPECT_TRUE(knn_matches[1].empty());
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  FeatureTypes::init("ORB", "ORB");
+  return RUN_ALL_TESTS();
+}
@@ -0,0 +1,123 @@
+/*!
+ *  \file test_mode_scheduler.cpp
+ *  \brief Unit tests of ModeScheduler::choose (default parameters: latency budget 50 ms,
+ *         refresh period 10 s, min 20 keypoints, keypoints lost below half of the last detection)
+ *  \author Arnaud Jacques, Alexandre Leclere, Boris Dehem
+ *  \date 2017
+ *
+ *  Simulated time is used (ros::Time::setNow), so that the refresh period can be tested.
+ */
+
+#include <ucl_drone/computer_vision/mode_scheduler.h>
+
+#include <boost/make_shared.hpp>
+
+#include <gtest/gtest.h>
+
+static const int DETECTION = ucl_drone::ModeDecision::DETECTION;
+static const int HYBRID    = ucl_drone::ModeDecision::HYBRID;
+static const int TRACKING  = ucl_drone::ModeDecision::TRACKING;
+
+class ModeSchedulerTest : public testing::Test
+{
+protected:
+  ModeScheduler scheduler;
+  ProcessedImage prev;
+  std::string reason;
+
+  virtual void SetUp()
+  {
+    ros::Time::setNow(ros::Time(1000));
+    prev.cv_img = boost::make_shared< cv_bridge::CvImage >();
+    prev.n_pts  = 100;
+  }
+
+  //! Measure an image with n_pts keypoints processed in mode
+  void measure(int mode, bool made_full_detection, double keypoints_time, double latency, int n_pts = 100)
+  {
+    ProcessedImage img;
+    img.n_pts          = n_pts;
+    img.keypoints_time = keypoints_time;
+    ucl_drone::ModeDecision msg;
+    scheduler.update(mode, "test", img, made_full_detection, latency, msg);
+  }
+
+  void wait(double seconds)
+  {
+    ros::Time::setNow(ros::Time::now() + ros::Duration(seconds));
+  }
+};
+
+// no previous image, or too few keypoints in it: nothing to track from
+TEST_F(ModeSchedulerTest, DetectionWithoutKeypoints)
+{
+  ProcessedImage first;
+  EXPECT_EQ(DETECTION, scheduler.choose(first, reason));
+
+  measure(DETECTION, true, 0.01, 0.02);
+  prev.n_pts = 19;
+  EXPECT_EQ(DETECTION, scheduler.choose(prev, reason));
+}
+
+TEST_F(ModeSchedulerTest, TrackingWhileKeypointsKept)
+{
+  measure(DETECTION, true, 0.01, 0.02);
+  EXPECT_EQ(TRACKING, scheduler.choose(prev, reason));
+  prev.n_pts = 50;  // half of the last detection is kept
+  EXPECT_EQ(TRACKING, scheduler.choose(prev, reason));
+}
+
+TEST_F(ModeSchedulerTest, DetectionWhenKeypointsLost)
+{
+  measure(DETECTION, true, 0.01, 0.02);
+  prev.n_pts = 49;
+  EXPECT_EQ(DETECTION, scheduler.choose(prev, reason));
+}
+
+TEST_F(ModeSchedulerTest, PeriodicDetection)
+{
+  measure(DETECTION, true, 0.01, 0.02);
+  wait(5);
+  EXPECT_EQ(TRACKING, scheduler.choose(prev, reason));
+  wait(6);
+  EXPECT_EQ(DETECTION, scheduler.choose(prev, reason));
+}
+
+// a mode never measured is expected to fit, so that it is tried once
+TEST_F(ModeSchedulerTest, HybridWhenDetectionOverBudget)
+{
+  measure(DETECTION, true, 0.2, 0.25);
+  prev.n_pts = 40;
+  EXPECT_EQ(HYBRID, scheduler.choose(prev, reason));
+
+  // hybrid is over budget too: the keypoints left are tracked
+  measure(HYBRID, false, 0.1, 0.15, 40);
+  EXPECT_EQ(TRACKING, scheduler.choose(prev, reason));
+}
+
+TEST_F(ModeSchedulerTest, OverdueDetection)
+{
+  measure(DETECTION, true, 0.2, 0.25);
+  wait(11);  // refresh period elapsed, but detection over budget
+  EXPECT_EQ(TRACKING, scheduler.choose(prev, reason));
+  wait(10);  // twice the refresh period: forced
+  EXPECT_EQ(DETECTION, scheduler.choose(prev, reason));
+}
+
+// a tracking failure (full detection made in tracking mode) counts as a detection
+TEST_F(ModeSchedulerTest, TrackingFailureCountsAsDetection)
+{
+  measure(DETECTION, true, 0.01, 0.02);
+  wait(9);
+  measure(TRACKING, true, 0.01, 0.02, 60);
+  wait(2);
+  prev.n_pts = 60;
+  EXPECT_EQ(TRACKING, scheduler.choose(prev, reason));
+}
+
+int main(int argc, char** argv)
+{
+  testing::InitGoogleTest(&argc, argv);
+  ros::Time::init();
+  return RUN_ALL_TESTS();
+}